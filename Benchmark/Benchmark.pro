@@ -0,0 +1,27 @@
+QT += quick
+QT += widgets
+QT += quickwidgets concurrent
+
+CONFIG += console
+CONFIG -= app_bundle
+
+# ZQuickWidget / QQuickWidget / MTWindow 三种实现的对比测试
+# 例：QT_QPA_PLATFORM=offscreen LIBGL_ALWAYS_SOFTWARE=1 ./Benchmark --duration 10 --output result.json
+
+include(../zquickwidget.pri)
+
+# qrc里的qml在编译期生成缓存，运行时不用再解析、编译
+CONFIG += qtquickcompiler
+
+INCLUDEPATH += ../Test
+
+SOURCES += \
+        main.cpp \
+        ../Test/multiThread/mtwindow.cpp \
+        ../Test/multiThread/planerenderer.cpp
+
+HEADERS += \
+    ../Test/multiThread/mtwindow.h \
+    ../Test/multiThread/planerenderer.h
+
+RESOURCES += benchmark.qrc
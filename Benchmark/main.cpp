@@ -0,0 +1,512 @@
+﻿#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMouseEvent>
+#include <QProcess>
+#include <QQuickWidget>
+#include <QQuickWindow>
+#include <QTimer>
+#include <QScopedPointer>
+#include <QAtomicInteger>
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "zquickwidget.h"
+#include "multiThread/mtwindow.h"
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+// 三种实现的对比测试
+// 同一个场景、同样的尺寸和时长下，输出渲染帧率、ui线程卡顿、帧延迟和CPU占用（JSON）
+// 一次只测一种配置；--backend all或给了多个尺寸时，逐个启动子进程再汇总，互不影响
+
+namespace {
+
+struct Options {
+    QString backend;
+    QString scene;
+    QString present;
+    QStringList sizes;
+    double duration;
+    double warmup;
+    int inputHz;
+    int guiLoadMs;
+};
+
+// 进程累计CPU时间，单位毫秒
+qint64 processCpuMs()
+{
+#ifdef Q_OS_WIN
+    FILETIME create, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &create, &exit, &kernel, &user))
+        return 0;
+    auto toMs = [](const FILETIME &t) {
+        return qint64((quint64(t.dwHighDateTime) << 32 | t.dwLowDateTime) / 10000);
+    };
+    return toMs(kernel) + toMs(user);
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return qint64(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000
+            + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+#endif
+}
+
+QUrl sceneUrl(const QString &scene)
+{
+    if (scene == QLatin1String("static") || scene == QLatin1String("animated")
+            || scene == QLatin1String("heavy") || scene == QLatin1String("input")
+            || scene == QLatin1String("spinner"))
+        return QUrl(QStringLiteral("qrc:/%1.qml").arg(scene));
+    return QUrl::fromUserInput(scene, QDir::currentPath());
+}
+
+QSize parseSize(const QString &text)
+{
+    const QStringList parts = text.split(QLatin1Char('x'));
+    if (parts.size() != 2)
+        return QSize();
+    return QSize(parts.at(0).toInt(), parts.at(1).toInt());
+}
+
+qint64 percentileOf(QVector<qint64> values, double p)
+{
+    if (values.isEmpty())
+        return -1;
+    const int n = values.size();
+    const int k = qBound(0, int(std::ceil(p / 100.0 * n)) - 1, n - 1);
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values.at(k);
+}
+
+// 用1ms的精确定时器探测ui线程：两次触发之间的间隔超出预期的部分就是卡顿
+class StallProbe : public QObject
+{
+public:
+    explicit StallProbe(QObject *parent = nullptr) : QObject(parent)
+    {
+        m_timer.setTimerType(Qt::PreciseTimer);
+        m_timer.setInterval(1);
+        connect(&m_timer, &QTimer::timeout, this, [this] {
+            const qint64 now = m_clock.nsecsElapsed();
+            if (m_last >= 0)
+                m_gapsUs.append((now - m_last) / 1000);
+            m_last = now;
+        });
+    }
+
+    void start()
+    {
+        m_gapsUs.clear();
+        m_last = -1;
+        m_clock.start();
+        m_timer.start();
+    }
+    void stop() { m_timer.stop(); }
+
+    QJsonObject result() const
+    {
+        // 超过4ms的间隔才算卡顿，定时器本身的抖动不计入
+        const qint64 thresholdUs = 4000;
+        qint64 stallUs = 0;
+        qint64 maxGap = 0;
+        for (qint64 gap : m_gapsUs) {
+            if (gap > thresholdUs)
+                stallUs += gap - 1000;
+            maxGap = qMax(maxGap, gap);
+        }
+
+        QJsonObject o;
+        o.insert(QStringLiteral("stallMs"), stallUs / 1000.0);
+        o.insert(QStringLiteral("maxGapMs"), maxGap / 1000.0);
+        o.insert(QStringLiteral("p99GapMs"), percentileOf(m_gapsUs, 99) / 1000.0);
+        return o;
+    }
+
+private:
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_last = -1;
+    QVector<qint64> m_gapsUs;
+};
+
+// 按固定频率给控件发悬停的鼠标移动，量到控件下一次开始绘制的时间
+// 对ZQuickWidget和QQuickWidget用同一种量法，可以直接比较；
+// 场景应当只随输入变化（input场景），否则动画引起的绘制会让结果偏小
+class InputProbe : public QObject
+{
+public:
+    InputProbe(QWidget *target, int hz, QObject *parent = nullptr)
+        : QObject(parent), m_target(target)
+    {
+        m_timer.setTimerType(Qt::PreciseTimer);
+        m_timer.setInterval(qMax(1, 1000 / qMax(1, hz)));
+        connect(&m_timer, &QTimer::timeout, this, &InputProbe::send);
+
+        // GpuPresent下真正绘制的是子控件
+        target->installEventFilter(this);
+        for (QWidget *child : target->findChildren<QWidget *>())
+            child->installEventFilter(this);
+    }
+
+    void start()
+    {
+        m_sentNs.clear();
+        m_latenciesUs.clear();
+        m_timer.start();
+    }
+    void stop() { m_timer.stop(); }
+
+    QJsonObject result() const
+    {
+        QJsonObject o;
+        o.insert(QStringLiteral("events"), m_latenciesUs.size());
+        o.insert(QStringLiteral("p50Ms"), percentileOf(m_latenciesUs, 50) / 1000.0);
+        o.insert(QStringLiteral("p99Ms"), percentileOf(m_latenciesUs, 99) / 1000.0);
+        return o;
+    }
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override
+    {
+        if (event->type() == QEvent::Paint && !m_sentNs.isEmpty()) {
+            const qint64 now = ZQuick::FrameTimings::now();
+            for (qint64 sent : qAsConst(m_sentNs))
+                m_latenciesUs.append((now - sent) / 1000);
+            m_sentNs.clear();
+        }
+        return QObject::eventFilter(watched, event);
+    }
+
+private:
+    void send()
+    {
+        // 在控件里来回画横线，每次位置都不同
+        m_x = (m_x + 7) % qMax(1, m_target->width());
+        const QPointF local(m_x, m_target->height() / 2);
+        QMouseEvent move(QEvent::MouseMove, local, m_target->mapToGlobal(local.toPoint()),
+                         Qt::NoButton, Qt::NoButton, Qt::NoModifier);
+        m_sentNs.append(ZQuick::FrameTimings::now());
+        QCoreApplication::sendEvent(m_target, &move);
+    }
+
+    QWidget *m_target;
+    QTimer m_timer;
+    int m_x = 0;
+    QVector<qint64> m_sentNs;
+    QVector<qint64> m_latenciesUs;
+};
+
+// 从ZQuickWidget的阶段记录里算每帧延迟：第一次polish开始到被ui线程取走
+QJsonObject frameLatency(const ZQuick::FrameTimings *timings, qint64 sinceNs)
+{
+    QHash<quint64, QPair<qint64, qint64>> frames;
+    const QVector<ZQuick::FrameTimings::Sample> samples = timings->samples();
+    for (const ZQuick::FrameTimings::Sample &s : samples) {
+        if (s.startNs < sinceNs || s.frame == 0)
+            continue;
+        auto it = frames.find(s.frame);
+        if (it == frames.end())
+            it = frames.insert(s.frame, qMakePair(qint64(-1), qint64(-1)));
+        if (s.phase == ZQuick::FrameTimings::Polish && (it->first < 0 || s.startNs < it->first))
+            it->first = s.startNs;
+        else if (s.phase == ZQuick::FrameTimings::Deliver)
+            it->second = qMax(it->second, s.endNs);
+    }
+
+    QVector<qint64> latencies;
+    for (const auto &f : qAsConst(frames)) {
+        if (f.first >= 0 && f.second >= f.first)
+            latencies.append((f.second - f.first) / 1000);
+    }
+
+    QJsonObject o;
+    o.insert(QStringLiteral("frames"), latencies.size());
+    o.insert(QStringLiteral("p50Ms"), latencies.isEmpty() ? -1 : percentileOf(latencies, 50) / 1000.0);
+    o.insert(QStringLiteral("p99Ms"), latencies.isEmpty() ? -1 : percentileOf(latencies, 99) / 1000.0);
+    return o;
+}
+
+QJsonObject runOne(const Options &opt, const QSize &size)
+{
+    const QUrl url = sceneUrl(opt.scene);
+    QAtomicInteger<quint64> rendered;
+
+    QWidget *widget = nullptr;
+    MTWindow *window = nullptr;
+    ZQuickWidget *zquick = nullptr;
+
+    if (opt.backend == QLatin1String("zquick")) {
+        zquick = new ZQuickWidget();
+        if (opt.present == QLatin1String("gpu"))
+            zquick->setPresentMode(ZQuickWidget::GpuPresent);
+        zquick->setSource(url);
+        widget = zquick;
+    } else if (opt.backend == QLatin1String("qquick")) {
+        QQuickWidget *q = new QQuickWidget();
+        q->setResizeMode(QQuickWidget::SizeRootObjectToView);
+        q->setSource(url);
+        widget = q;
+    } else {
+        window = new MTWindow(url.toString());
+    }
+
+    if (widget) {
+        widget->resize(size);
+        widget->show();
+    } else {
+        window->resize(size);
+        window->show();
+    }
+
+    // MTWindow在第一次expose时才创建场景，所以在预热结束后再连接
+    auto quickWindow = [&]() -> QQuickWindow * {
+        if (zquick)
+            return zquick->quickWindow();
+        if (widget)
+            return static_cast<QQuickWidget *>(widget)->quickWindow();
+        return window->quickWindow();
+    };
+
+    QEventLoop loop;
+    QTimer::singleShot(int(opt.warmup * 1000), &loop, &QEventLoop::quit);
+    loop.exec();
+
+    QQuickWindow *qw = quickWindow();
+    QMetaObject::Connection counter;
+    if (qw) {
+        // afterRendering在渲染线程上发出，直接计数
+        counter = QObject::connect(qw, &QQuickWindow::afterRendering, qw, [&rendered] {
+            rendered.fetchAndAddRelaxed(1);
+        }, Qt::DirectConnection);
+    } else {
+        qWarning() << "Benchmark: no QQuickWindow for backend" << opt.backend;
+    }
+
+    const ZQuick::FrameStats statsBefore = zquick ? zquick->frameStats() : ZQuick::FrameStats();
+    const qint64 sinceNs = ZQuick::FrameTimings::now();
+
+    StallProbe probe;
+    QScopedPointer<InputProbe> input;
+    if (opt.inputHz > 0 && widget) {
+        // QQuickWidget不开鼠标跟踪时收不到不按键的移动
+        widget->setMouseTracking(true);
+        input.reset(new InputProbe(widget, opt.inputHz));
+        if (zquick)
+            zquick->resetInputLatency();
+    }
+
+    // 模拟繁忙的ui线程：每16ms里有guiLoadMs毫秒被占住
+    QTimer load;
+    if (opt.guiLoadMs > 0) {
+        const int busyMs = opt.guiLoadMs;
+        QObject::connect(&load, &QTimer::timeout, [busyMs] {
+            QElapsedTimer busy;
+            busy.start();
+            while (busy.elapsed() < busyMs) {}
+        });
+    }
+
+    QElapsedTimer wall;
+    const qint64 cpuBefore = processCpuMs();
+    probe.start();
+    if (input)
+        input->start();
+    if (opt.guiLoadMs > 0)
+        load.start(16);
+    wall.start();
+
+    QTimer::singleShot(int(opt.duration * 1000), &loop, &QEventLoop::quit);
+    loop.exec();
+
+    load.stop();
+    probe.stop();
+    if (input)
+        input->stop();
+    const qint64 wallMs = qMax<qint64>(1, wall.elapsed());
+    const qint64 cpuMs = processCpuMs() - cpuBefore;
+    QObject::disconnect(counter);
+
+    QJsonObject o;
+    o.insert(QStringLiteral("backend"), opt.backend);
+    o.insert(QStringLiteral("scene"), opt.scene);
+    o.insert(QStringLiteral("size"), QStringLiteral("%1x%2").arg(size.width()).arg(size.height()));
+    o.insert(QStringLiteral("durationMs"), wallMs);
+    o.insert(QStringLiteral("frames"), qint64(rendered.loadRelaxed()));
+    o.insert(QStringLiteral("fps"), rendered.loadRelaxed() * 1000.0 / wallMs);
+    o.insert(QStringLiteral("gui"), probe.result());
+    o.insert(QStringLiteral("cpuPercent"), cpuMs * 100.0 / wallMs);
+    o.insert(QStringLiteral("guiLoadMs"), opt.guiLoadMs);
+    if (input)
+        o.insert(QStringLiteral("inputLatency"), input->result());
+
+    if (zquick) {
+        const ZQuick::FrameStats stats = zquick->frameStats();
+        QJsonObject s;
+        s.insert(QStringLiteral("published"), qint64(stats.published - statsBefore.published));
+        s.insert(QStringLiteral("presented"), qint64(stats.presented - statsBefore.presented));
+        s.insert(QStringLiteral("superseded"), qint64(stats.superseded - statsBefore.superseded));
+        s.insert(QStringLiteral("dropped"), qint64(stats.dropped - statsBefore.dropped));
+        s.insert(QStringLiteral("unchanged"), qint64(stats.unchanged - statsBefore.unchanged));
+        o.insert(QStringLiteral("present"), opt.present);
+        o.insert(QStringLiteral("frameStats"), s);
+        o.insert(QStringLiteral("latency"), frameLatency(zquick->frameTimings(), sinceNs));
+
+        const ZQuick::StartupTimings t = zquick->startupTimings();
+        QJsonObject startup;
+        startup.insert(QStringLiteral("engineMs"), t.engine);
+        startup.insert(QStringLiteral("compileMs"), t.compile);
+        startup.insert(QStringLiteral("contextMs"), t.context);
+        startup.insert(QStringLiteral("sceneMs"), t.scene);
+        startup.insert(QStringLiteral("createMs"), t.create);
+        startup.insert(QStringLiteral("firstFrameMs"), t.firstFrame);
+        startup.insert(QStringLiteral("totalMs"), t.total);
+        o.insert(QStringLiteral("startup"), startup);
+        if (input) {
+            // 控件自己按帧序号对应的输入延迟，量到绘制结束
+            const ZQuick::LatencyHistogram &h = zquick->inputLatency();
+            QJsonObject l;
+            l.insert(QStringLiteral("events"), qint64(h.count()));
+            l.insert(QStringLiteral("p50Ms"), h.percentile(50) / 1000.0);
+            l.insert(QStringLiteral("p99Ms"), h.percentile(99) / 1000.0);
+            l.insert(QStringLiteral("maxMs"), h.max() / 1000.0);
+            o.insert(QStringLiteral("inputToPhoton"), l);
+        }
+    } else {
+        // 其它实现拿不到分阶段的时间
+        QJsonObject l;
+        l.insert(QStringLiteral("frames"), -1);
+        l.insert(QStringLiteral("p50Ms"), -1);
+        l.insert(QStringLiteral("p99Ms"), -1);
+        o.insert(QStringLiteral("latency"), l);
+    }
+
+    delete widget;
+    delete window;
+    return o;
+}
+
+// 每个配置单独起一个子进程，避免上一个后端残留的线程和GL资源影响结果
+QJsonArray runAll(const Options &opt, const QStringList &backends)
+{
+    QJsonArray results;
+    for (const QString &backend : backends) {
+        for (const QString &size : opt.sizes) {
+            QStringList args;
+            args << QStringLiteral("--backend") << backend
+                 << QStringLiteral("--scene") << opt.scene
+                 << QStringLiteral("--size") << size
+                 << QStringLiteral("--duration") << QString::number(opt.duration)
+                 << QStringLiteral("--warmup") << QString::number(opt.warmup)
+                 << QStringLiteral("--present") << opt.present
+                 << QStringLiteral("--input") << QString::number(opt.inputHz)
+                 << QStringLiteral("--gui-load") << QString::number(opt.guiLoadMs);
+
+            QProcess child;
+            child.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+            child.start(QCoreApplication::applicationFilePath(), args);
+            const int timeout = int((opt.duration + opt.warmup) * 1000) + 30000;
+            if (!child.waitForFinished(timeout) || child.exitCode() != 0) {
+                qWarning() << "Benchmark: run failed" << backend << size;
+                child.kill();
+                continue;
+            }
+
+            const QJsonDocument doc = QJsonDocument::fromJson(child.readAllStandardOutput());
+            for (const QJsonValue &v : doc.array())
+                results.append(v);
+        }
+    }
+    return results;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    // 默认不需要显示器，可用Mesa软件渲染：LIBGL_ALWAYS_SOFTWARE=1
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", QByteArray("offscreen"));
+
+    QCoreApplication::setAttribute(Qt::AA_ShareOpenGLContexts);
+    QApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("ZQuickBenchmark"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("ZQuickWidget / QQuickWidget / MTWindow benchmark"));
+    parser.addHelpOption();
+    QCommandLineOption backendOpt(QStringLiteral("backend"), QStringLiteral("zquick, qquick, mtwindow or all"), QStringLiteral("name"), QStringLiteral("all"));
+    QCommandLineOption sceneOpt(QStringLiteral("scene"), QStringLiteral("static, animated, heavy, input, spinner or a qml url"), QStringLiteral("scene"), QStringLiteral("animated"));
+    QCommandLineOption sizeOpt(QStringLiteral("size"), QStringLiteral("WxH[,WxH...]"), QStringLiteral("sizes"), QStringLiteral("800x600"));
+    QCommandLineOption durationOpt(QStringLiteral("duration"), QStringLiteral("Measured seconds"), QStringLiteral("s"), QStringLiteral("5"));
+    QCommandLineOption warmupOpt(QStringLiteral("warmup"), QStringLiteral("Seconds before measuring"), QStringLiteral("s"), QStringLiteral("1"));
+    QCommandLineOption presentOpt(QStringLiteral("present"), QStringLiteral("ZQuickWidget present mode: cpu or gpu"), QStringLiteral("mode"), QStringLiteral("cpu"));
+    QCommandLineOption inputOpt(QStringLiteral("input"), QStringLiteral("Send hover mouse moves at this rate and measure input latency (0 = off)"), QStringLiteral("hz"), QStringLiteral("0"));
+    QCommandLineOption guiLoadOpt(QStringLiteral("gui-load"), QStringLiteral("Keep the GUI thread busy for this long in every 16 ms (0 = off)"), QStringLiteral("ms"), QStringLiteral("0"));
+    QCommandLineOption outputOpt(QStringLiteral("output"), QStringLiteral("Write JSON to file instead of stdout"), QStringLiteral("file"));
+    parser.addOptions({backendOpt, sceneOpt, sizeOpt, durationOpt, warmupOpt, presentOpt, inputOpt, guiLoadOpt, outputOpt});
+    parser.process(app);
+
+    Options opt;
+    opt.backend = parser.value(backendOpt);
+    opt.scene = parser.value(sceneOpt);
+    opt.present = parser.value(presentOpt);
+    opt.sizes = parser.value(sizeOpt).split(QLatin1Char(','), Qt::SkipEmptyParts);
+    opt.duration = parser.value(durationOpt).toDouble();
+    opt.warmup = parser.value(warmupOpt).toDouble();
+    opt.inputHz = parser.value(inputOpt).toInt();
+    opt.guiLoadMs = qBound(0, parser.value(guiLoadOpt).toInt(), 16);
+
+    const QStringList known = {QStringLiteral("zquick"), QStringLiteral("qquick"), QStringLiteral("mtwindow")};
+    if (opt.backend != QLatin1String("all") && !known.contains(opt.backend)) {
+        qWarning() << "Benchmark: unknown backend" << opt.backend;
+        return 1;
+    }
+    if (opt.sizes.isEmpty() || opt.duration <= 0) {
+        qWarning() << "Benchmark: invalid size or duration";
+        return 1;
+    }
+
+    QJsonArray results;
+    if (opt.backend == QLatin1String("all") || opt.sizes.size() > 1) {
+        results = runAll(opt, opt.backend == QLatin1String("all") ? known : QStringList{opt.backend});
+    } else {
+        const QSize size = parseSize(opt.sizes.first());
+        if (size.isEmpty()) {
+            qWarning() << "Benchmark: invalid size" << opt.sizes.first();
+            return 1;
+        }
+        results.append(runOne(opt, size));
+    }
+
+    const QByteArray json = QJsonDocument(results).toJson(QJsonDocument::Indented);
+    if (parser.isSet(outputOpt)) {
+        QFile file(parser.value(outputOpt));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qWarning() << "Benchmark: cannot write" << file.fileName();
+            return 1;
+        }
+        file.write(json);
+    } else {
+        QFile out;
+        out.open(stdout, QIODevice::WriteOnly);
+        out.write(json);
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+import QtQuick 2.15
+
+// 持续动画：普通的属性动画 + 一个时钟文本，每帧都需要polish和sync
+Rectangle {
+    id: root
+    color: "#202020"
+
+    Repeater {
+        model: 50
+        Rectangle {
+            width: 40
+            height: 40
+            radius: 20
+            color: Qt.hsla(index / 50, 0.7, 0.5, 1)
+            y: (index * 37) % Math.max(1, root.height - height)
+
+            NumberAnimation on x {
+                from: 0
+                to: Math.max(0, root.width - 40)
+                duration: 1000 + index * 40
+                loops: Animation.Infinite
+            }
+        }
+    }
+
+    Text {
+        id: clock
+        anchors.centerIn: parent
+        color: "white"
+        font.pixelSize: 48
+        text: "0"
+    }
+
+    Timer {
+        interval: 16
+        running: true
+        repeat: true
+        onTriggered: clock.text = Date.now()
+    }
+}
@@ -0,0 +1,20 @@
+import QtQuick 2.15
+
+// 只随输入变化：方块跟着鼠标走，用来量输入到上屏的延迟
+Rectangle {
+    color: "#202020"
+
+    MouseArea {
+        id: area
+        anchors.fill: parent
+        hoverEnabled: true
+    }
+
+    Rectangle {
+        width: 40
+        height: 40
+        color: "orange"
+        x: area.mouseX - width / 2
+        y: area.mouseY - height / 2
+    }
+}
@@ -0,0 +1,67 @@
+import QtQuick 2.15
+
+// 只有Animator：转圈、进度条和淡入淡出，动画在渲染线程上推进，
+// 配合--gui-load看ui线程繁忙时渲染帧率是否还能保持
+Rectangle {
+    id: root
+    color: "#202020"
+
+    Grid {
+        anchors.centerIn: parent
+        columns: 6
+        spacing: 20
+
+        Repeater {
+            model: 24
+            Item {
+                width: 60
+                height: 60
+
+                Rectangle {
+                    anchors.fill: parent
+                    radius: width / 2
+                    color: "transparent"
+                    border.width: 6
+                    border.color: Qt.hsla(index / 24, 0.7, 0.5, 1)
+
+                    Rectangle {
+                        width: 12
+                        height: 12
+                        radius: 6
+                        color: "white"
+                        anchors.horizontalCenter: parent.horizontalCenter
+                    }
+
+                    RotationAnimator on rotation {
+                        from: 0
+                        to: 360
+                        duration: 800 + index * 20
+                        loops: Animation.Infinite
+                    }
+                }
+
+                OpacityAnimator on opacity {
+                    from: 1
+                    to: 0.3
+                    duration: 600
+                    loops: Animation.Infinite
+                }
+            }
+        }
+    }
+
+    Rectangle {
+        id: bar
+        anchors.bottom: parent.bottom
+        width: 80
+        height: 10
+        color: "#55aaff"
+
+        XAnimator on x {
+            from: 0
+            to: Math.max(0, root.width - bar.width)
+            duration: 1500
+            loops: Animation.Infinite
+        }
+    }
+}
@@ -0,0 +1,26 @@
+import QtQuick 2.15
+
+// 静态画面：理想情况下加载完成后不应再产生任何帧
+Rectangle {
+    color: "#336699"
+
+    Grid {
+        anchors.fill: parent
+        anchors.margins: 10
+        columns: 8
+        spacing: 4
+
+        Repeater {
+            model: 64
+            Rectangle {
+                width: 60
+                height: 40
+                color: Qt.hsla(index / 64, 0.6, 0.5, 1)
+                Text {
+                    anchors.centerIn: parent
+                    text: index
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,16 @@
+# 共享内存帧环形缓冲的读端示例和吞吐测试，不依赖Qt，只能在Linux上编译
+# 也可以直接：g++ -O2 -std=c++11 -I.. main.cpp -o shmreader -lrt
+
+TEMPLATE = app
+CONFIG += console c++11
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += ..
+
+SOURCES += \
+        main.cpp
+
+HEADERS += \
+    ../zshmframering.h
+
+LIBS += -lrt
@@ -0,0 +1,243 @@
+﻿// 共享内存帧环形缓冲的读端示例和吞吐测试，不依赖Qt
+//   g++ -O2 -std=c++11 -I.. main.cpp -o shmreader -lrt
+//
+//   shmreader read <name> [seconds]        读取SharedMemoryFrameSink发布的帧，每秒打印一次统计
+//   shmreader bench [WxH] [slots] [seconds] 子进程尽快写、父进程读，与同样大小的帧走管道对比
+
+#include "zshmframering.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <signal.h>
+#include <sys/wait.h>
+
+using namespace ZQuick;
+
+namespace {
+
+double seconds()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// 模拟消费者：把整帧读一遍，编码器、推流同样要读完所有像素
+uint64_t consume(const uint8_t *pixels, uint32_t stride, uint32_t height)
+{
+    uint64_t sum = 0;
+    const uint64_t *p = reinterpret_cast<const uint64_t *>(pixels);
+    const size_t words = size_t(stride) * height / 8;
+    for (size_t i = 0; i < words; ++i)
+        sum += p[i];
+    return sum;
+}
+
+struct Stats
+{
+    uint64_t frames = 0;
+    uint64_t missed = 0;    // 读端太慢，被写端覆盖掉没读到的帧
+    uint64_t torn = 0;      // 读的过程中被覆盖，结果作废
+    uint64_t bytes = 0;
+};
+
+// 读到写端关闭或超时为止
+Stats readLoop(ShmFrameRing::Reader &reader, double duration, bool verbose)
+{
+    Stats total, second;
+    uint64_t last = 0;
+    uint64_t checksum = 0;
+    const double start = seconds();
+    double lastPrint = start;
+
+    while (seconds() - start < duration) {
+        const uint64_t latest = reader.wait(last, 100);
+        if (latest <= last) {
+            if (!reader.writerAlive())
+                break;
+            continue;
+        }
+
+        // 只处理最新的一帧，中间来不及处理的算作丢帧
+        if (last && latest > last + 1)
+            second.missed += latest - last - 1;
+        last = latest;
+
+        ShmFrameRing::Frame frame;
+        if (!reader.acquire(latest, &frame)) {
+            ++second.torn;
+            continue;
+        }
+        checksum += consume(frame.pixels, frame.stride, frame.height);
+        if (!reader.isValid(frame)) {
+            ++second.torn;
+            continue;
+        }
+        ++second.frames;
+        second.bytes += uint64_t(frame.stride) * frame.height;
+
+        const double now = seconds();
+        if (verbose && now - lastPrint >= 1.0) {
+            printf("%ux%u fmt=%u frame=%llu fps=%.1f MB/s=%.1f missed=%llu torn=%llu\n",
+                   frame.width, frame.height, frame.format,
+                   (unsigned long long)frame.frameNumber,
+                   second.frames / (now - lastPrint), second.bytes / (now - lastPrint) / 1e6,
+                   (unsigned long long)second.missed, (unsigned long long)second.torn);
+            fflush(stdout);
+            lastPrint = now;
+            total.frames += second.frames;
+            total.missed += second.missed;
+            total.torn += second.torn;
+            total.bytes += second.bytes;
+            second = Stats();
+        }
+    }
+
+    total.frames += second.frames;
+    total.missed += second.missed;
+    total.torn += second.torn;
+    total.bytes += second.bytes;
+    // 防止读像素的循环被优化掉
+    if (checksum == 1)
+        printf(" ");
+    return total;
+}
+
+int readMode(const char *name, double duration)
+{
+    ShmFrameRing::Reader reader;
+    if (!reader.open(name)) {
+        fprintf(stderr, "cannot open shared memory %s\n", name);
+        return 1;
+    }
+    readLoop(reader, duration, true);
+    return 0;
+}
+
+bool writeAll(int fd, const uint8_t *data, size_t size)
+{
+    while (size) {
+        const ssize_t n = write(fd, data, size);
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= size_t(n);
+    }
+    return true;
+}
+
+bool readAll(int fd, uint8_t *data, size_t size)
+{
+    while (size) {
+        const ssize_t n = read(fd, data, size);
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= size_t(n);
+    }
+    return true;
+}
+
+int benchMode(uint32_t width, uint32_t height, uint32_t slots, double duration)
+{
+    const uint32_t stride = width * 4;
+    const size_t frameBytes = size_t(stride) * height;
+    const std::string name = "/zquick-shm-bench-" + std::to_string(getpid());
+
+    // 共享内存：子进程写，父进程读
+    ShmFrameRing::Writer writer;
+    if (!writer.open(name, slots, frameBytes)) {
+        fprintf(stderr, "cannot create shared memory %s\n", name.c_str());
+        return 1;
+    }
+
+    const pid_t child = fork();
+    if (child == 0) {
+        std::vector<uint8_t> pixels(frameBytes);
+        uint64_t n = 0;
+        const double start = seconds();
+        while (seconds() - start < duration) {
+            pixels[n % frameBytes] = uint8_t(n);
+            writer.write(pixels.data(), width, height, stride, ShmFrameRing::Bgra8Premultiplied, ++n, 0);
+        }
+        writer.close();
+        _exit(0);
+    }
+
+    ShmFrameRing::Reader reader;
+    if (!reader.open(name)) {
+        fprintf(stderr, "cannot open shared memory %s\n", name.c_str());
+        kill(child, SIGKILL);
+        return 1;
+    }
+    const double shmStart = seconds();
+    const Stats shm = readLoop(reader, duration + 1, false);
+    const double shmTime = seconds() - shmStart;
+    waitpid(child, nullptr, 0);
+    reader.close();
+    writer.close();
+
+    // 管道：同样大小的帧，原来的做法
+    int fds[2];
+    if (pipe(fds) != 0)
+        return 1;
+    const pid_t pipeChild = fork();
+    if (pipeChild == 0) {
+        close(fds[0]);
+        std::vector<uint8_t> pixels(frameBytes);
+        const double start = seconds();
+        while (seconds() - start < duration) {
+            if (!writeAll(fds[1], pixels.data(), frameBytes))
+                break;
+        }
+        close(fds[1]);
+        _exit(0);
+    }
+    close(fds[1]);
+    std::vector<uint8_t> buffer(frameBytes);
+    uint64_t pipeFrames = 0;
+    uint64_t checksum = 0;
+    const double pipeStart = seconds();
+    while (readAll(fds[0], buffer.data(), frameBytes)) {
+        checksum += consume(buffer.data(), stride, height);
+        ++pipeFrames;
+    }
+    const double pipeTime = seconds() - pipeStart;
+    close(fds[0]);
+    waitpid(pipeChild, nullptr, 0);
+    if (checksum == 1)
+        printf(" ");
+
+    printf("frame %ux%u (%.1f MB), %u slots, %.1f s\n", width, height, frameBytes / 1e6, slots, duration);
+    printf("shm : %8.1f frames/s %9.1f MB/s  missed=%llu torn=%llu\n",
+           shm.frames / shmTime, shm.bytes / shmTime / 1e6,
+           (unsigned long long)shm.missed, (unsigned long long)shm.torn);
+    printf("pipe: %8.1f frames/s %9.1f MB/s\n",
+           pipeFrames / pipeTime, pipeFrames * double(frameBytes) / pipeTime / 1e6);
+    return 0;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc >= 3 && std::string(argv[1]) == "read")
+        return readMode(argv[2], argc >= 4 ? atof(argv[3]) : 1e9);
+
+    if (argc >= 2 && std::string(argv[1]) == "bench") {
+        unsigned width = 1920, height = 1080;
+        if (argc >= 3 && sscanf(argv[2], "%ux%u", &width, &height) != 2) {
+            fprintf(stderr, "invalid size %s\n", argv[2]);
+            return 1;
+        }
+        const uint32_t slots = argc >= 4 ? uint32_t(atoi(argv[3])) : 4;
+        const double duration = argc >= 5 ? atof(argv[4]) : 3;
+        return benchMode(width, height, slots, duration);
+    }
+
+    fprintf(stderr, "usage: %s read <name> [seconds]\n"
+                    "       %s bench [WxH] [slots] [seconds]\n", argv[0], argv[0]);
+    return 1;
+}
@@ -6,8 +6,12 @@ QT += quickwidgets concurrent
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+include(../zquickwidget.pri)
+
+# qrc里的qml在编译期生成缓存，运行时不用再解析、编译
+CONFIG += qtquickcompiler
+
 SOURCES += \
-        ../zquickwidget.cpp \
         multiThread/mtwindow.cpp \
         multiThread/planerenderer.cpp \
         main.cpp \
@@ -26,6 +30,5 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
 HEADERS += \
-    ../zquickwidget.h \
     multiThread/mtwindow.h \
     multiThread/planerenderer.h
@@ -23,6 +23,8 @@ int main(int argc, char *argv[])
         QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
 #endif
     }
+    // ZQuickWidget的GpuPresent模式需要共享上下文
+    QCoreApplication::setAttribute(Qt::AA_ShareOpenGLContexts);
     QApplication app(argc, argv);
 
 
@@ -36,7 +38,14 @@ int main(int argc, char *argv[])
     QWidget *qWidget = QWidget::createWindowContainer(tWin);
 #elif defined(USE_CUSTOM)
     // 基于Qt例程实现的qml渲染器
+    // 启动时先在后台编译，多个面板共用engine时第一次打开不用再等编译
+    // ZQuickWidget::warmUp({QUrl("qrc:/main.qml")});
+    // ZQuickWidget *qWidget = new ZQuickWidget(ZQuickWidget::sharedEngine());
     ZQuickWidget *qWidget = new ZQuickWidget();
+    // 不经过CPU读回，直接显示渲染线程的纹理
+    // qWidget->setPresentMode(ZQuickWidget::GpuPresent);
+    // 嵌入式平台CPU较弱时，在GPU上完成翻转和通道转换
+    // qWidget->setGpuConvert(true);
 #else
     // Qt自带的渲染引擎
     QQuickWidget *qWidget = new QQuickWidget();
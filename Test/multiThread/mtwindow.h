@@ -73,6 +73,8 @@ public:
     MTWindow(QString qmlFile);
     ~MTWindow();
 
+    QQuickWindow *quickWindow() const { return m_quickWindow; }
+
 protected:
     void exposeEvent(QExposeEvent *e) override;
     void resizeEvent(QResizeEvent *e) override;
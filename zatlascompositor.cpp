@@ -0,0 +1,260 @@
+﻿#include "zatlascompositor.h"
+#include "zquickwidget.h"
+#include "zrenderthreadpool.h"
+#include "zpixelconvert.h"
+
+#include <QCoreApplication>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QOffscreenSurface>
+#include <QThread>
+
+using namespace ZQuick;
+
+// 同一轮里提交的帧都拷进图集之后再读回
+static const QEvent::Type ATLAS_READBACK = QEvent::Type(QEvent::User + 8);
+
+// 区域按这个粒度分配，与fbo的分档一致，改变尺寸时大部分情况下不用重新分配
+static const int SLOT_BUCKET = 128;
+
+static QSize slotSize(const QSize &size)
+{
+    return QSize((size.width() + SLOT_BUCKET - 1) / SLOT_BUCKET * SLOT_BUCKET,
+                 (size.height() + SLOT_BUCKET - 1) / SLOT_BUCKET * SLOT_BUCKET);
+}
+
+// 读回的大图里切出一块，共享同一块内存；切片全部释放之前大图不会被改写。
+// 切片是可写的：只读的QImage在bits()时会悄悄拷贝，信箱复用槽里的图像时就失去了零拷贝；
+// 各个切片的区域互不重叠，控件往自己的切片里写不会影响别人
+static QImage sliceOf(const QImage &image, const QRect &rect)
+{
+    QImage *owner = new QImage(image);
+    // constBits()不会分离，owner与m_image共享，之后m_image因为不再独占而重新分配
+    uchar *bits = const_cast<uchar *>(owner->constBits()) + rect.y() * owner->bytesPerLine() + rect.x() * 4;
+    return QImage(bits, rect.width(), rect.height(), owner->bytesPerLine(), owner->format(),
+                  [](void *info) { delete static_cast<QImage *>(info); }, owner);
+}
+
+AtlasCompositor::AtlasCompositor(const QSize &atlasSize)
+    : QObject(nullptr),
+    m_atlasSize(atlasSize.expandedTo(QSize(SLOT_BUCKET, SLOT_BUCKET))),
+    m_fbo(nullptr),
+    m_readFbo(0),
+    m_readbackPosted(false),
+    m_readbacks(0),
+    m_slices(0)
+{
+    // 与控件自己创建上下文的方式相同，控件的纹理要通过全局共享组才能在这里使用
+    QOpenGLContext *share = QOpenGLContext::globalShareContext();
+    m_supported = share != nullptr;
+    if (!m_supported)
+        qWarning("AtlasCompositor: needs Qt::AA_ShareOpenGLContexts, widgets will read back on their own");
+
+    m_context = new QOpenGLContext;
+    m_context->setFormat(QSurfaceFormat::defaultFormat());
+    if (share)
+        m_context->setShareContext(share);
+    m_context->create();
+
+    m_surface = new QOffscreenSurface;
+    m_surface->setFormat(m_context->format());
+    m_surface->create();
+
+    // 自己和上下文都住在渲染线程上，不能有parent，由调用者负责删除
+    m_thread = RenderThreadPool::instance()->acquire();
+    m_context->moveToThread(m_thread);
+    moveToThread(m_thread);
+}
+
+AtlasCompositor::~AtlasCompositor()
+{
+    // 在渲染线程上释放GL资源，并把上下文和自己移回ui线程
+    if (QThread::currentThread() != thread())
+        QMetaObject::invokeMethod(this, [this] { cleanup(); }, Qt::BlockingQueuedConnection);
+    else
+        cleanup();
+
+    RenderThreadPool::instance()->release(m_thread);
+
+    delete m_surface;
+    delete m_context;
+}
+
+void AtlasCompositor::cleanup()
+{
+    if (m_context->makeCurrent(m_surface)) {
+        delete m_fbo;
+        m_fbo = nullptr;
+        if (m_readFbo)
+            m_context->functions()->glDeleteFramebuffers(1, &m_readFbo);
+        m_readFbo = 0;
+        m_context->doneCurrent();
+    }
+    m_pending.clear();
+
+    QThread *gui = QCoreApplication::instance()->thread();
+    m_context->moveToThread(gui);
+    moveToThread(gui);
+}
+
+QRect AtlasCompositor::allocate(const QSize &size)
+{
+    // 先找释放掉的同样大小的区域
+    for (int i = 0; i < m_free.size(); ++i) {
+        if (m_free.at(i).size() == size)
+            return m_free.takeAt(i);
+    }
+
+    // 再找同样高度、还有空位的架子
+    for (Shelf &shelf : m_shelves) {
+        if (shelf.height == size.height() && shelf.x + size.width() <= m_atlasSize.width()) {
+            const QRect rect(shelf.x, shelf.y, size.width(), size.height());
+            shelf.x += size.width();
+            return rect;
+        }
+    }
+
+    // 最后开一个新的架子
+    const int y = m_shelves.isEmpty() ? 0 : m_shelves.last().y + m_shelves.last().height;
+    if (y + size.height() > m_atlasSize.height() || size.width() > m_atlasSize.width())
+        return QRect();
+
+    m_shelves.append({y, size.height(), size.width()});
+    return QRect(0, y, size.width(), size.height());
+}
+
+void AtlasCompositor::release(const QRect &rect)
+{
+    if (!rect.isNull())
+        m_free.append(rect);
+}
+
+QRect AtlasCompositor::place(QuickRenderer *renderer, const QSize &size)
+{
+    const QSize wanted = slotSize(size);
+    QRect slot = m_slots.value(renderer);
+
+    // 原来的区域装得下、且最多大一档时继续用
+    if (slot.isNull() || slot.width() < size.width() || slot.height() < size.height()
+            || slot.width() > wanted.width() + SLOT_BUCKET || slot.height() > wanted.height() + SLOT_BUCKET) {
+        release(slot);
+        slot = allocate(wanted);
+        if (slot.isNull()) {
+            m_slots.remove(renderer);
+            return QRect();
+        }
+        m_slots.insert(renderer, slot);
+    }
+
+    return QRect(slot.topLeft(), size);
+}
+
+bool AtlasCompositor::submit(QuickRenderer *renderer, GLuint texture, const QSize &size, quint64 sequence, GLsync fence)
+{
+    if (!m_supported || !QOpenGLFramebufferObject::hasOpenGLFramebufferBlit())
+        return false;
+
+    // 同一个renderer在读回之前又提交了一帧，旧的被新的取代
+    for (int i = 0; i < m_pending.size(); ++i) {
+        if (m_pending.at(i).renderer == renderer) {
+            m_pending.remove(i);
+            break;
+        }
+    }
+
+    const QRect rect = place(renderer, size);
+    if (rect.isNull() || !m_context->makeCurrent(m_surface))
+        return false;
+
+    QOpenGLExtraFunctions *f = m_context->extraFunctions();
+    if (!m_fbo) {
+        m_fbo = new QOpenGLFramebufferObject(m_atlasSize);
+        f->glGenFramebuffers(1, &m_readFbo);
+    }
+
+    // 控件的上下文画完之前不能读它的纹理
+    if (fence) {
+        f->glWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+        f->glDeleteSync(fence);
+    }
+
+    // fbo对象不能跨上下文共享，纹理可以：挂到自己的fbo上作为来源。
+    // 场景画在纹理左下角size大小的区域；两边都是GL坐标，不需要翻转
+    f->glBindFramebuffer(GL_READ_FRAMEBUFFER, m_readFbo);
+    f->glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_fbo->handle());
+    f->glBlitFramebuffer(0, 0, size.width(), size.height(),
+                         rect.x(), rect.y(), rect.x() + rect.width(), rect.y() + rect.height(),
+                         GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    // 纹理随控件的fbo改变尺寸时被删除，不留引用
+    f->glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    f->glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    m_pending.append({renderer, rect, sequence});
+
+    // 普通优先级：排在这时已经在队列里的其它渲染器的render之后，赶上的一起读回，
+    // 赶不上的进下一次；低优先级在持续有动画时会一直排不上
+    if (!m_readbackPosted) {
+        m_readbackPosted = true;
+        QCoreApplication::postEvent(this, new QEvent(ATLAS_READBACK));
+    }
+    return true;
+}
+
+void AtlasCompositor::remove(QuickRenderer *renderer)
+{
+    release(m_slots.take(renderer));
+    for (int i = 0; i < m_pending.size(); ++i) {
+        if (m_pending.at(i).renderer == renderer) {
+            m_pending.remove(i);
+            break;
+        }
+    }
+}
+
+bool AtlasCompositor::event(QEvent *e)
+{
+    if (e->type() == ATLAS_READBACK) {
+        m_readbackPosted = false;
+        readback();
+        return true;
+    }
+    return QObject::event(e);
+}
+
+void AtlasCompositor::readback()
+{
+    if (m_pending.isEmpty() || !m_fbo || !m_context->makeCurrent(m_surface))
+        return;
+
+    // 只读所有待读区域的外接矩形
+    QRect bounds;
+    for (const Pending &p : qAsConst(m_pending))
+        bounds |= p.rect;
+
+    QOpenGLFunctions *f = m_context->functions();
+    m_fbo->bind();
+    f->glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    m_pixels.resize(bounds.width() * bounds.height() * 4);
+    f->glReadPixels(bounds.x(), bounds.y(), bounds.width(), bounds.height(),
+                    GL_RGBA, GL_UNSIGNED_BYTE, m_pixels.data());
+    m_fbo->release();
+
+    // 上一次的大图还被控件的切片持有时，这里会重新分配，不会改写它们正在画的内容
+    PixelConvert::flipRgbaToImage(reinterpret_cast<const uchar *>(m_pixels.constData()),
+                                  bounds.width(), bounds.height(), &m_image);
+    m_readbacks.fetchAndAddRelaxed(1);
+
+    // 翻转之后，GL坐标里的区域换算成图像里从上往下的坐标
+    const QVector<Pending> pending = m_pending;
+    m_pending.clear();
+    for (const Pending &p : pending) {
+        const QRect rect(p.rect.x() - bounds.x(),
+                         bounds.y() + bounds.height() - (p.rect.y() + p.rect.height()),
+                         p.rect.width(), p.rect.height());
+        p.renderer->publishSlice(sliceOf(m_image, rect), p.sequence);
+        m_slices.fetchAndAddRelaxed(1);
+    }
+}
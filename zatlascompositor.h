@@ -0,0 +1,107 @@
+﻿#ifndef ZATLASCOMPOSITOR_H
+#define ZATLASCOMPOSITOR_H
+
+#include <QObject>
+#include <QHash>
+#include <QVector>
+#include <QRect>
+#include <QImage>
+#include <QByteArray>
+#include <QAtomicInteger>
+#include <qopengl.h>
+
+QT_FORWARD_DECLARE_CLASS(QOpenGLContext)
+QT_FORWARD_DECLARE_CLASS(QOffscreenSurface)
+QT_FORWARD_DECLARE_CLASS(QOpenGLFramebufferObject)
+QT_FORWARD_DECLARE_CLASS(QThread)
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+class QuickRenderer;
+
+// 多个小控件共用一次读回
+// 加入同一个合成器的控件共用一个渲染线程，各自渲染进自己的fbo；合成器在自己的上下文里
+// 把这些fbo的纹理拷（glBlitFramebuffer）到一张大的图集fbo里属于各自的区域，
+// 同一轮渲染完的控件由一次glReadPixels一起读回，每个控件拿到的是这张大图里自己那一块
+// （共享同一块内存，不再拷贝），照常画出来。
+// 驱动上每次读回的固定开销很大时（Mesa、嵌入式GPU），多个小的读回合并成一个能省很多。
+//
+// 一个上下文不能安全地服务多个QQuickRenderControl，所以每个控件仍然有自己的上下文，
+// 与合成器的上下文同在全局共享组里，需要在创建QApplication之前设置Qt::AA_ShareOpenGLContexts。
+// Qt5的QQuickWindow只能画在渲染目标的原点，不能直接画进图集的一块区域，因此多一次GPU上的拷贝。
+// 图集放不下或者不支持时，控件自动退回自己读回。
+// 合成器在ui线程上创建和删除，要比使用它的控件活得久
+class AtlasCompositor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AtlasCompositor(const QSize &atlasSize = QSize(2048, 2048));
+    ~AtlasCompositor() override;
+
+    QSize atlasSize() const { return m_atlasSize; }
+    // 没有全局共享上下文时不能使用，控件照常各自读回
+    bool isSupported() const { return m_supported; }
+
+    // 以下在渲染线程上由QuickRenderer调用
+    // 把renderer这一帧的纹理（左下角size大小的区域）拷进图集，之后由合成器统一读回并调用
+    // renderer->publishSlice()；fence为renderer的上下文画完这一帧的fence，由合成器等待并删除，
+    // 为空时调用者须已glFinish。返回false表示放不下或不支持，调用者自己读回，fence仍归调用者。
+    // 返回后当前上下文是合成器的，调用者下次使用GL前要重新makeCurrent
+    bool submit(QuickRenderer *renderer, GLuint texture, const QSize &size, quint64 sequence, GLsync fence);
+    // renderer清理时调用，释放它的区域和还没读回的帧
+    void remove(QuickRenderer *renderer);
+
+    // 读回次数和合并的帧数，可在任意线程读取（仅供统计）
+    quint64 readbacks() const { return m_readbacks.loadRelaxed(); }
+    quint64 slices() const { return m_slices.loadRelaxed(); }
+
+protected:
+    bool event(QEvent *e) override;
+
+private:
+    struct Pending {
+        QuickRenderer *renderer;
+        QRect rect;         // 在图集里的区域，GL坐标（原点在左下）
+        quint64 sequence;
+    };
+    struct Shelf {
+        int y;
+        int height;
+        int x;
+    };
+
+    QRect place(QuickRenderer *renderer, const QSize &size);
+    QRect allocate(const QSize &size);
+    void release(const QRect &rect);
+    void readback();
+    void cleanup();
+
+    QSize m_atlasSize;
+    bool m_supported;
+    QOpenGLContext *m_context;
+    QOffscreenSurface *m_surface;
+    QThread *m_thread;
+    QOpenGLFramebufferObject *m_fbo;
+    GLuint m_readFbo;           // 挂上各个控件的纹理作为blit的来源
+
+    QHash<QuickRenderer *, QRect> m_slots;  // 分配给每个renderer的区域（按档取整）
+    QVector<Shelf> m_shelves;
+    QVector<QRect> m_free;
+
+    QVector<Pending> m_pending;
+    bool m_readbackPosted;
+    QByteArray m_pixels;
+    QImage m_image;
+
+    QAtomicInteger<quint64> m_readbacks;
+    QAtomicInteger<quint64> m_slices;
+};
+
+}
+
+#endif // ZATLASCOMPOSITOR_H
@@ -0,0 +1,102 @@
+﻿#include "zcomponentcache.h"
+
+#include <QQmlEngine>
+#include <QQmlComponent>
+#include <QDebug>
+
+using namespace ZQuick;
+
+ComponentCache::ComponentCache(QQmlEngine *engine)
+    : QObject(engine),
+    m_engine(engine)
+{
+    m_clock.start();
+}
+
+ComponentCache *ComponentCache::forEngine(QQmlEngine *engine)
+{
+    ComponentCache *cache = engine->findChild<ComponentCache *>(QString(), Qt::FindDirectChildrenOnly);
+    if (!cache)
+        cache = new ComponentCache(engine);
+    return cache;
+}
+
+QQmlComponent *ComponentCache::component(const QUrl &url, QQmlComponent::CompilationMode mode)
+{
+    QQmlComponent *c = m_components.value(url);
+
+    // 出错的组件不缓存，下次重新加载（文件可能已经修好了）
+    if (c && c->isError()) {
+        m_components.remove(url);
+        c->deleteLater();
+        c = nullptr;
+    }
+
+    if (!c) {
+        c = new QQmlComponent(m_engine, url, mode, this);
+        m_components.insert(url, c);
+    }
+
+    return c;
+}
+
+void ComponentCache::warmUp(const QList<QUrl> &urls)
+{
+    for (const QUrl &url : urls) {
+        if (m_warming.contains(url))
+            continue;
+
+        // 已经编译好的不用再来一遍，但同样要通知
+        m_warming.insert(url, m_clock.elapsed());
+        QQmlComponent *existing = m_components.value(url);
+        QQmlComponent *c = existing && existing->isReady()
+                ? existing : component(url, QQmlComponent::Asynchronous);
+        if (c->isLoading()) {
+            connect(c, &QQmlComponent::statusChanged, this, [this, url](QQmlComponent::Status status) {
+                if (status != QQmlComponent::Loading)
+                    warmUpDone(url);
+            });
+        } else {
+            // 缓存命中、或engine里已经有这个类型时，构造完就是Ready。
+            // 信号排队发出：调用者通常在warmUp()之后才connect，同步发出就收不到了
+            QMetaObject::invokeMethod(this, [this, url] { warmUpDone(url); }, Qt::QueuedConnection);
+        }
+    }
+}
+
+void ComponentCache::warmUpDone(const QUrl &url)
+{
+    if (!m_warming.contains(url))
+        return;
+
+    const qint64 waited = m_clock.elapsed() - m_warming.take(url);
+    QQmlComponent *c = m_components.value(url);
+    const bool ok = c && c->isReady();
+    // 缓存命中的沿用第一次编译的耗时
+    const qint64 compileMs = ok ? m_compileMs.value(url, waited) : waited;
+    if (c) {
+        disconnect(c, &QQmlComponent::statusChanged, this, nullptr);
+        if (!ok)
+            qWarning() << "ComponentCache: warm-up failed" << url << c->errors();
+    }
+
+    m_compileMs.insert(url, compileMs);
+    emit componentReady(url, compileMs, ok);
+    if (m_warming.isEmpty())
+        emit warmUpFinished();
+}
+
+void ComponentCache::remove(const QUrl &url)
+{
+    if (QQmlComponent *c = m_components.take(url))
+        c->deleteLater();
+    m_compileMs.remove(url);
+}
+
+void ComponentCache::clear()
+{
+    for (QQmlComponent *c : qAsConst(m_components))
+        c->deleteLater();
+    m_components.clear();
+    m_compileMs.clear();
+}
@@ -0,0 +1,64 @@
+﻿#ifndef ZCOMPONENTCACHE_H
+#define ZCOMPONENTCACHE_H
+
+#include <QObject>
+#include <QHash>
+#include <QUrl>
+#include <QElapsedTimer>
+#include <QQmlComponent>
+
+QT_FORWARD_DECLARE_CLASS(QQmlEngine)
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+// 按url缓存已编译的QQmlComponent，同一个engine上的控件共用
+// 缓存是engine的子对象，随engine一起销毁；只能在engine所在线程使用
+class ComponentCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    static ComponentCache *forEngine(QQmlEngine *engine);
+
+    // 没有缓存时新建，返回的组件可能还处于Loading状态
+    // 组件归缓存所有，使用者不要delete
+    QQmlComponent *component(const QUrl &url,
+                             QQmlComponent::CompilationMode mode = QQmlComponent::PreferSynchronous);
+
+    // 预热：在后台加载、编译这些qml（解析、类型编译和import的插件加载都在QML的加载线程上），
+    // 结果留在缓存里，之后setSource同一个url时直接创建对象。
+    // 每个url完成时发出componentReady，全部完成后发出warmUpFinished；
+    // 已经在缓存里的url同样会通知，信号总是在warmUp()返回之后才发出
+    void warmUp(const QList<QUrl> &urls);
+    bool isWarmingUp() const { return !m_warming.isEmpty(); }
+    // 从开始加载到编译完成的时间，单位毫秒；还没完成或不是通过warmUp加载的返回-1
+    qint64 compileTime(const QUrl &url) const { return m_compileMs.value(url, -1); }
+
+    bool contains(const QUrl &url) const { return m_components.contains(url); }
+    void remove(const QUrl &url);
+    void clear();
+
+    QQmlEngine *engine() const { return m_engine; }
+
+signals:
+    void componentReady(const QUrl &url, qint64 compileMs, bool ok);
+    void warmUpFinished();
+
+private:
+    explicit ComponentCache(QQmlEngine *engine);
+    void warmUpDone(const QUrl &url);
+
+    QQmlEngine *m_engine;
+    QHash<QUrl, QQmlComponent *> m_components;
+    QElapsedTimer m_clock;
+    QHash<QUrl, qint64> m_warming;      // 正在预热的url和开始时间
+    QHash<QUrl, qint64> m_compileMs;
+};
+
+}
+
+#endif // ZCOMPONENTCACHE_H
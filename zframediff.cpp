@@ -0,0 +1,190 @@
+﻿#include "zframediff.h"
+
+#include "zsimd_p.h"
+
+using namespace ZQuick;
+
+// 每个32位通道独立地做 h = rotl(h, 7) + pixel。
+// 每一步对pixel和h都是一一映射，同一通道里只有一个像素变化时哈希一定会变
+static const quint32 HASH_SEED = 0x9e3779b9u;
+
+static inline quint32 rotl7(quint32 v)
+{
+    return (v << 7) | (v >> 25);
+}
+
+static inline quint64 foldLanes(const quint32 *lanes, int count, quint32 tail)
+{
+    quint64 h = 0xcbf29ce484222325ull;
+    for (int i = 0; i < count; ++i)
+        h = (h ^ lanes[i]) * 0x100000001b3ull;
+    return (h ^ tail) * 0x100000001b3ull;
+}
+
+// 与SSE2版本结果相同：4个通道，第i个像素进入第i%4个通道
+Q_DECL_UNUSED static quint64 hashTileScalar(const uchar *bits, int bpl, int width, int rows)
+{
+    quint32 lanes[4] = {HASH_SEED, HASH_SEED, HASH_SEED, HASH_SEED};
+    quint32 tail = HASH_SEED;
+    const int vectorWidth = width & ~3;
+
+    for (int y = 0; y < rows; ++y) {
+        const quint32 *p = reinterpret_cast<const quint32 *>(bits + y * bpl);
+        for (int x = 0; x < vectorWidth; ++x)
+            lanes[x & 3] = rotl7(lanes[x & 3]) + p[x];
+        for (int x = vectorWidth; x < width; ++x)
+            tail = rotl7(tail) + p[x];
+    }
+    return foldLanes(lanes, 4, tail);
+}
+
+#ifdef ZQUICK_HAVE_SSE2
+static quint64 hashTileSse2(const uchar *bits, int bpl, int width, int rows)
+{
+    __m128i acc = _mm_set1_epi32(int(HASH_SEED));
+    quint32 tail = HASH_SEED;
+    const int vectorWidth = width & ~3;
+
+    for (int y = 0; y < rows; ++y) {
+        const quint32 *p = reinterpret_cast<const quint32 *>(bits + y * bpl);
+        for (int x = 0; x < vectorWidth; x += 4) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + x));
+            acc = _mm_or_si128(_mm_slli_epi32(acc, 7), _mm_srli_epi32(acc, 25));
+            acc = _mm_add_epi32(acc, v);
+        }
+        for (int x = vectorWidth; x < width; ++x)
+            tail = rotl7(tail) + p[x];
+    }
+
+    quint32 lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+    return foldLanes(lanes, 4, tail);
+}
+#endif
+
+#ifdef ZQUICK_HAVE_AVX2
+// 8个通道，结果与另外两种实现不同，但同一进程里只会用同一种
+ZQUICK_TARGET_AVX2
+static quint64 hashTileAvx2(const uchar *bits, int bpl, int width, int rows)
+{
+    __m256i acc = _mm256_set1_epi32(int(HASH_SEED));
+    quint32 tail = HASH_SEED;
+    const int vectorWidth = width & ~7;
+
+    for (int y = 0; y < rows; ++y) {
+        const quint32 *p = reinterpret_cast<const quint32 *>(bits + y * bpl);
+        for (int x = 0; x < vectorWidth; x += 8) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + x));
+            acc = _mm256_or_si256(_mm256_slli_epi32(acc, 7), _mm256_srli_epi32(acc, 25));
+            acc = _mm256_add_epi32(acc, v);
+        }
+        for (int x = vectorWidth; x < width; ++x)
+            tail = rotl7(tail) + p[x];
+    }
+
+    quint32 lanes[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+    return foldLanes(lanes, 8, tail);
+}
+#endif
+
+typedef quint64 (*HashTileFn)(const uchar *bits, int bpl, int width, int rows);
+
+struct HashImpl {
+    HashTileFn fn;
+    const char *name;
+};
+
+static HashImpl selectImpl()
+{
+#ifdef ZQUICK_HAVE_AVX2
+    if (cpuHasAvx2())
+        return {hashTileAvx2, "avx2"};
+#endif
+#ifdef ZQUICK_HAVE_SSE2
+    return {hashTileSse2, "sse2"};
+#else
+    return {hashTileScalar, "scalar"};
+#endif
+}
+
+static const HashImpl &hashImpl()
+{
+    static const HashImpl impl = selectImpl();
+    return impl;
+}
+
+FrameDiff::FrameDiff(int tileSize)
+    : m_tileSize(qMax(tileSize, 8)),
+    m_format(QImage::Format_Invalid)
+{
+}
+
+const char *FrameDiff::implementation()
+{
+    return hashImpl().name;
+}
+
+void FrameDiff::reset()
+{
+    m_size = QSize();
+    m_hashes.clear();
+}
+
+QRegion FrameDiff::update(const QImage &image)
+{
+    if (image.isNull())
+        return QRegion();
+
+    // 只处理32位像素的格式，其他格式一律视为全部变化
+    if (image.depth() != 32) {
+        reset();
+        return QRegion(image.rect());
+    }
+
+    const int cols = (image.width() + m_tileSize - 1) / m_tileSize;
+    const int rows = (image.height() + m_tileSize - 1) / m_tileSize;
+    const bool full = image.size() != m_size || image.format() != m_format
+            || m_hashes.size() != cols * rows;
+
+    if (full) {
+        m_size = image.size();
+        m_format = image.format();
+        m_hashes.fill(0, cols * rows);
+    }
+
+    const HashTileFn hashTile = hashImpl().fn;
+    const uchar *bits = image.constBits();
+    const int bpl = image.bytesPerLine();
+
+    QRegion damage;
+    for (int ty = 0; ty < rows; ++ty) {
+        const int y = ty * m_tileSize;
+        const int h = qMin(m_tileSize, image.height() - y);
+
+        // 同一行里连续变化的块合并成一个矩形，QRegion里的矩形少一些
+        int runStart = -1;
+        for (int tx = 0; tx <= cols; ++tx) {
+            bool dirty = false;
+            if (tx < cols) {
+                const int x = tx * m_tileSize;
+                const int w = qMin(m_tileSize, image.width() - x);
+                const quint64 hash = hashTile(bits + y * bpl + x * 4, bpl, w, h);
+                quint64 &old = m_hashes[ty * cols + tx];
+                dirty = hash != old;
+                old = hash;
+            }
+
+            if (dirty && runStart < 0) {
+                runStart = tx;
+            } else if (!dirty && runStart >= 0) {
+                const int x = runStart * m_tileSize;
+                const int w = qMin(tx * m_tileSize, image.width()) - x;
+                damage += QRect(x, y, w, h);
+                runStart = -1;
+            }
+        }
+    }
+
+    return full ? QRegion(image.rect()) : damage;
+}
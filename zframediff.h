@@ -0,0 +1,42 @@
+﻿#ifndef ZFRAMEDIFF_H
+#define ZFRAMEDIFF_H
+
+#include <QImage>
+#include <QRegion>
+#include <QVector>
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+// 比较相邻两帧，得到发生变化的区域
+// 图像切成tileSize大小的块，每块算一个哈希，只保存哈希，不保存上一帧图像；
+// 哈希按CPU支持的指令集选择AVX2/SSE2/普通实现，运行时检测
+class FrameDiff
+{
+public:
+    explicit FrameDiff(int tileSize = 32);
+
+    // 与上一次传入的图像比较，返回变化的区域（图像像素坐标），没有变化时为空；
+    // 第一帧或尺寸、格式改变时返回整幅图像
+    QRegion update(const QImage &image);
+
+    // 下一帧视为全部变化
+    void reset();
+
+    int tileSize() const { return m_tileSize; }
+    // 当前使用的实现："avx2"、"sse2"或"scalar"
+    static const char *implementation();
+
+private:
+    int m_tileSize;
+    QSize m_size;
+    QImage::Format m_format;
+    QVector<quint64> m_hashes;
+};
+
+}
+
+#endif // ZFRAMEDIFF_H
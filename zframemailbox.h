@@ -0,0 +1,127 @@
+﻿#ifndef ZFRAMEMAILBOX_H
+#define ZFRAMEMAILBOX_H
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QImage>
+#include <QRegion>
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+struct FrameStats
+{
+    quint64 published = 0;   // 渲染线程投递的帧数
+    quint64 presented = 0;   // ui线程真正取走的帧数
+    quint64 superseded = 0;  // 还没被取走就被更新的帧覆盖掉的帧数
+    quint64 dropped = 0;     // 渲染还没完成时，被合并掉的刷新请求数
+    quint64 unchanged = 0;   // 画面与上一帧完全相同、没有投递的帧数
+};
+
+// 三缓冲、只保留最新一帧的信箱
+// 单生产者（渲染线程）、单消费者（ui线程），无锁
+// 生产者往writeSlot()里写，publish()之后与中间槽交换；
+// 消费者consume()时若中间槽有新帧，就与readSlot()交换
+template <typename T>
+class FrameMailbox
+{
+public:
+    FrameMailbox()
+        : m_state(1),
+        m_writeIndex(0),
+        m_readIndex(2)
+    {
+    }
+
+    // 仅生产者调用
+    T &writeSlot() { return m_slots[m_writeIndex]; }
+
+    // 仅生产者调用，返回true表示上一帧还没被取走就被覆盖了
+    bool publish()
+    {
+        const int old = m_state.fetchAndStoreOrdered(m_writeIndex | FreshBit);
+        m_writeIndex = old & IndexMask;
+        m_published.ref();
+
+        const bool superseded = old & FreshBit;
+        if (superseded)
+            m_superseded.ref();
+        return superseded;
+    }
+
+    // 仅生产者调用，用于合并“从上次被取走以来”的信息（例如脏区域）
+    // 结果只会偏保守：返回true时上一帧也可能刚好被取走
+    bool hasUnconsumed() const { return m_state.loadAcquire() & FreshBit; }
+
+    // 仅消费者调用，返回true表示readSlot()换成了新的一帧
+    bool consume()
+    {
+        if (!(m_state.loadAcquire() & FreshBit))
+            return false;
+
+        const int old = m_state.fetchAndStoreOrdered(m_readIndex);
+        m_readIndex = old & IndexMask;
+        m_presented.ref();
+        return true;
+    }
+
+    // 仅消费者调用
+    T &readSlot() { return m_slots[m_readIndex]; }
+    const T &readSlot() const { return m_slots[m_readIndex]; }
+
+    // 遍历全部槽位，仅在生产者和消费者都停下来之后调用（例如释放资源）
+    T &slotAt(int i) { return m_slots[i]; }
+    static int slotCount() { return 3; }
+
+    // 保证同一时间最多只有一个待处理的刷新通知
+    // 生产者publish()后调用，返回true时才需要通知消费者
+    bool requestNotify() { return m_notifyPending.testAndSetOrdered(0, 1); }
+    // 消费者收到通知后、在取帧之前调用
+    void clearNotify() { m_notifyPending.storeRelease(0); }
+
+    void markDropped() { m_dropped.ref(); }
+    void markUnchanged() { m_unchanged.ref(); }
+
+    FrameStats stats() const
+    {
+        FrameStats s;
+        s.published = m_published.loadRelaxed();
+        s.presented = m_presented.loadRelaxed();
+        s.superseded = m_superseded.loadRelaxed();
+        s.dropped = m_dropped.loadRelaxed();
+        s.unchanged = m_unchanged.loadRelaxed();
+        return s;
+    }
+
+private:
+    enum { IndexMask = 0x3, FreshBit = 0x4 };
+
+    T m_slots[3];
+    QAtomicInt m_state;     // 中间槽的下标 | FreshBit
+    int m_writeIndex;       // 只有生产者访问
+    int m_readIndex;        // 只有消费者访问
+    QAtomicInt m_notifyPending;
+
+    QAtomicInteger<quint64> m_published;
+    QAtomicInteger<quint64> m_presented;
+    QAtomicInteger<quint64> m_superseded;
+    QAtomicInteger<quint64> m_dropped;
+    QAtomicInteger<quint64> m_unchanged;
+};
+
+struct RenderedFrame
+{
+    QImage image;
+    quint64 sequence = 0;   // 对应的sync帧号
+    qint64 publishedNs = 0; // 投递时间，FrameTimings::now()
+    QRegion damage;         // 自上次被取走以来变化的区域，图像像素坐标
+};
+
+typedef FrameMailbox<RenderedFrame> ImageMailbox;
+
+}
+
+#endif // ZFRAMEMAILBOX_H
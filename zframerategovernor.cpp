@@ -0,0 +1,119 @@
+﻿#include "zframerategovernor.h"
+
+#include <QTimer>
+#include <cmath>
+
+using namespace ZQuick;
+
+// 耗时的平滑系数，越小越平稳
+static const double COST_SMOOTHING = 0.2;
+// 按耗时计算帧率时留出的余量，避免刚好卡在边缘上
+static const double COST_HEADROOM = 1.2;
+// 超过这个时间没有新帧视为空闲
+static const int IDLE_TIMEOUT = 500;
+
+FrameRateGovernor::FrameRateGovernor(QObject *parent)
+    : QObject(parent),
+    m_targetFps(60),
+    m_maxFps(0),
+    m_minFps(1),
+    m_renderCost(0),
+    m_guiCost(0),
+    m_rate(0),
+    m_reason(Idle)
+{
+    m_idleTimer = new QTimer(this);
+    m_idleTimer->setSingleShot(true);
+    m_idleTimer->setInterval(IDLE_TIMEOUT);
+    connect(m_idleTimer, &QTimer::timeout, this, &FrameRateGovernor::onIdle);
+}
+
+void FrameRateGovernor::setTargetFps(int fps)
+{
+    m_targetFps = qMax(0, fps);
+    if (m_reason != Idle)
+        updateRate();
+}
+
+void FrameRateGovernor::setMaxFps(int fps)
+{
+    m_maxFps = qMax(0, fps);
+    if (m_reason != Idle)
+        updateRate();
+}
+
+void FrameRateGovernor::setMinFps(int fps)
+{
+    m_minFps = qMax(1, fps);
+    if (m_reason != Idle)
+        updateRate();
+}
+
+int FrameRateGovernor::delayForNextFrame() const
+{
+    // 空闲之后的第一帧不用等
+    if (m_rate <= 0 || !m_lastFrame.isValid())
+        return 0;
+
+    const qint64 interval = qint64(1000.0 / m_rate);
+    return int(qMax<qint64>(0, interval - m_lastFrame.elapsed()));
+}
+
+void FrameRateGovernor::frameStarted(qint64 renderCostNs)
+{
+    if (renderCostNs > 0)
+        m_renderCost += COST_SMOOTHING * (renderCostNs - m_renderCost);
+
+    m_lastFrame.start();
+    m_idleTimer->start();
+    updateRate();
+}
+
+void FrameRateGovernor::addGuiCost(qint64 ns)
+{
+    m_guiCost += COST_SMOOTHING * (ns - m_guiCost);
+}
+
+void FrameRateGovernor::updateRate()
+{
+    // 0表示不限制
+    qreal rate = m_targetFps > 0 ? m_targetFps : 0;
+    Reason reason = Target;
+
+    if (m_maxFps > 0 && (rate <= 0 || rate > m_maxFps)) {
+        rate = m_maxFps;
+        reason = MaxFps;
+    }
+
+    // GUI和渲染线程是并行的，能达到的帧率取决于较慢的那一边
+    const double cost = qMax(m_renderCost, m_guiCost) * COST_HEADROOM;
+    if (cost > 0) {
+        const qreal affordable = 1e9 / cost;
+        if (rate <= 0 || affordable < rate) {
+            rate = affordable;
+            reason = Budget;
+        }
+        if (rate < m_minFps) {
+            rate = m_minFps;
+            reason = MinFps;
+        }
+    }
+
+    setRate(rate, reason);
+}
+
+void FrameRateGovernor::setRate(qreal fps, Reason reason)
+{
+    // 平滑后的耗时每帧都会有些许变化，变化不到半帧就不通知
+    if (reason == m_reason && std::fabs(fps - m_rate) < 0.5)
+        return;
+
+    m_rate = fps;
+    m_reason = reason;
+    emit rateChanged(m_rate, m_reason);
+}
+
+void FrameRateGovernor::onIdle()
+{
+    setRate(0, Idle);
+}
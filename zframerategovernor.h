@@ -0,0 +1,82 @@
+﻿#ifndef ZFRAMERATEGOVERNOR_H
+#define ZFRAMERATEGOVERNOR_H
+
+#include <QObject>
+#include <QElapsedTimer>
+
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+// 控件的帧率控制
+// 两帧之间至少间隔1/rate秒，太早到来的刷新请求推迟到时间到了再合并处理；
+// rate默认等于目标帧率，渲染耗时（取平滑后的值）跟不上时逐步降低，但不低于最低帧率。
+// 一段时间没有新帧视为空闲，帧率为0。只能在ui线程使用
+class FrameRateGovernor : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Reason {
+        Idle,       // 没有刷新请求
+        Target,     // 按目标帧率
+        MaxFps,     // 目标帧率超过了最高帧率
+        Budget,     // 渲染耗时跟不上，主动降低
+        MinFps      // 渲染耗时连最低帧率都跟不上，按最低帧率
+    };
+    Q_ENUM(Reason)
+
+    explicit FrameRateGovernor(QObject *parent = nullptr);
+
+    // 0表示不限制，默认60
+    void setTargetFps(int fps);
+    int targetFps() const { return m_targetFps; }
+    // 0表示不限制，默认0
+    void setMaxFps(int fps);
+    int maxFps() const { return m_maxFps; }
+    // 默认1
+    void setMinFps(int fps);
+    int minFps() const { return m_minFps; }
+
+    qreal currentFps() const { return m_rate; }
+    Reason reason() const { return m_reason; }
+
+    // 距离下一帧允许开始还要等多少毫秒
+    int delayForNextFrame() const;
+
+    // 一帧开始时调用，renderCostNs是上一帧在渲染线程上的耗时
+    void frameStarted(qint64 renderCostNs);
+    // ui线程上polish加等待sync的耗时
+    void addGuiCost(qint64 ns);
+
+    // 平滑后的单帧耗时，纳秒
+    qint64 frameCost() const { return qint64(qMax(m_renderCost, m_guiCost)); }
+
+signals:
+    void rateChanged(qreal fps, ZQuick::FrameRateGovernor::Reason reason);
+
+private:
+    void updateRate();
+    void setRate(qreal fps, Reason reason);
+    void onIdle();
+
+    int m_targetFps;
+    int m_maxFps;
+    int m_minFps;
+
+    double m_renderCost;    // 指数平滑
+    double m_guiCost;
+    qreal m_rate;
+    Reason m_reason;
+
+    QElapsedTimer m_lastFrame;
+    QTimer *m_idleTimer;
+};
+
+}
+
+#endif // ZFRAMERATEGOVERNOR_H
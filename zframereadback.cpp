@@ -0,0 +1,180 @@
+﻿#include "zframereadback.h"
+#include "zpixelconvert.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+
+using namespace ZQuick;
+
+FrameReadback::FrameReadback(int ringSize)
+    : m_slots(qMax(2, ringSize))
+{
+}
+
+FrameReadback::~FrameReadback()
+{
+    // cleanup()需要current的上下文，只能由使用者在渲染线程里调用
+    Q_ASSERT(m_pending == 0);
+}
+
+bool FrameReadback::initialize(QOpenGLContext *ctx)
+{
+    m_context = ctx;
+
+    const QSurfaceFormat fmt = ctx->format();
+    if (ctx->isOpenGLES())
+        m_supported = fmt.majorVersion() >= 3;
+    else
+        m_supported = fmt.version() >= qMakePair(3, 2)
+                || (fmt.version() >= qMakePair(3, 0) && ctx->hasExtension("GL_ARB_sync"));
+
+    if (!m_supported)
+        qWarning("FrameReadback: PBO/fence not available, falling back to synchronous readback");
+
+    return m_supported;
+}
+
+void FrameReadback::cleanup()
+{
+    if (!m_context)
+        return;
+
+    QOpenGLExtraFunctions *f = m_context->extraFunctions();
+    for (Slot &slot : m_slots) {
+        release(slot);
+        if (slot.pbo) {
+            f->glDeleteBuffers(1, &slot.pbo);
+            slot.pbo = 0;
+        }
+        slot.size = QSize();
+        slot.bytes = 0;
+    }
+
+    m_head = 0;
+    m_pending = 0;
+    m_context = nullptr;
+}
+
+void FrameReadback::queue(QOpenGLFramebufferObject *fbo, const QSize &size, quint64 frame,
+                          bool converted)
+{
+    if (!m_supported || size.isEmpty())
+        return;
+
+    // 环满了说明GPU落后太多，只能等最早那一帧，正常情况下不会走到这里
+    if (m_pending == m_slots.size()) {
+        Slot &oldest = m_slots[(m_head + m_slots.size() - m_pending) % m_slots.size()];
+        isSignaled(oldest, true);
+        release(oldest);
+        m_pending--;
+    }
+
+    QOpenGLExtraFunctions *f = m_context->extraFunctions();
+    Slot &slot = m_slots[m_head];
+
+    const int bytes = size.width() * size.height() * 4;
+    if (!slot.pbo)
+        f->glGenBuffers(1, &slot.pbo);
+
+    f->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    if (slot.bytes != bytes) {
+        f->glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+        slot.bytes = bytes;
+    }
+    slot.size = size;
+    slot.frame = frame;
+    slot.converted = converted;
+
+    fbo->bind();
+    f->glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    f->glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    slot.fence = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    f->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // 确保读取命令真正提交给GPU，否则fence永远不会触发
+    f->glFlush();
+
+    m_head = (m_head + 1) % m_slots.size();
+    m_pending++;
+}
+
+bool FrameReadback::takeLatest(QImage *image, bool wait, quint64 *frame)
+{
+    if (!m_supported || m_pending == 0)
+        return false;
+
+    // 从最早的一帧开始往后找，找到最后一个已完成的
+    int latest = -1;
+    int done = 0;
+    for (int i = 0; i < m_pending; ++i) {
+        const int idx = (m_head + m_slots.size() - m_pending + i) % m_slots.size();
+        if (!isSignaled(m_slots[idx], wait && i == 0 && latest < 0))
+            break;
+        latest = idx;
+        done = i + 1;
+    }
+
+    if (latest < 0)
+        return false;
+
+    bool ok = false;
+    for (int i = 0; i < done; ++i) {
+        const int idx = (m_head + m_slots.size() - m_pending + i) % m_slots.size();
+        if (idx == latest) {
+            ok = mapInto(m_slots[idx], image);
+            if (ok && frame)
+                *frame = m_slots[idx].frame;
+        }
+        release(m_slots[idx]);
+    }
+    m_pending -= done;
+
+    return ok;
+}
+
+bool FrameReadback::isSignaled(Slot &slot, bool wait)
+{
+    if (!slot.fence)
+        return true;
+
+    QOpenGLExtraFunctions *f = m_context->extraFunctions();
+    const GLenum r = f->glClientWaitSync(slot.fence,
+                                         wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                         wait ? GLuint64(1000000000) : 0);
+    return r == GL_ALREADY_SIGNALED || r == GL_CONDITION_SATISFIED;
+}
+
+void FrameReadback::release(Slot &slot)
+{
+    if (slot.fence) {
+        m_context->extraFunctions()->glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+    }
+}
+
+bool FrameReadback::mapInto(Slot &slot, QImage *image)
+{
+    QOpenGLExtraFunctions *f = m_context->extraFunctions();
+
+    f->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    const uchar *data = static_cast<const uchar *>(
+                f->glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.bytes, GL_MAP_READ_BIT));
+    bool ok = false;
+    if (data) {
+        // PBO里是自下而上的RGBA数据，翻转和转成ARGB32_Premultiplied一次完成，
+        // 直接写进调用者的图像里，ui线程绘制时不用再转换；GPU上已经转换过的直接拷贝
+        if (slot.converted)
+            PixelConvert::copyArgb32ToImage(data, slot.size.width(), slot.size.height(), image);
+        else
+            PixelConvert::flipRgbaToImage(data, slot.size.width(), slot.size.height(), image);
+        // 映射期间显存内容丢失（例如模式切换）时返回GL_FALSE，读到的数据不可信
+        ok = f->glUnmapBuffer(GL_PIXEL_PACK_BUFFER) == GL_TRUE;
+        if (!ok)
+            qWarning("FrameReadback: glUnmapBuffer reported corrupted data");
+    } else {
+        qWarning("FrameReadback: glMapBufferRange failed");
+    }
+    f->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return ok;
+}
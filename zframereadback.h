@@ -0,0 +1,70 @@
+﻿#ifndef ZFRAMEREADBACK_H
+#define ZFRAMEREADBACK_H
+
+#include <QImage>
+#include <QSize>
+#include <QVector>
+#include <qopengl.h>
+
+QT_FORWARD_DECLARE_CLASS(QOpenGLContext)
+QT_FORWARD_DECLARE_CLASS(QOpenGLFramebufferObject)
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+// 基于PBO环形缓冲的异步读取
+// glReadPixels写入PBO后立即返回，配合fence在后续帧里再map，
+// 这样渲染线程不会因为等GPU而卡住
+// 所有函数都必须在渲染线程、且上下文为current时调用
+class FrameReadback
+{
+public:
+    explicit FrameReadback(int ringSize = 3);
+    ~FrameReadback();
+
+    // 检查当前上下文是否支持PBO + fence(GL 3.0+/GLES 3.0+)
+    bool initialize(QOpenGLContext *ctx);
+    void cleanup();
+
+    bool isSupported() const { return m_supported; }
+
+    // 从fbo中发起一次异步读取，size为有效区域（左下角为原点）
+    // frame是调用者的帧号，取出时原样返回
+    // converted为true表示fbo已经是GpuConvertPass的结果，取出时直接拷贝，不再翻转换通道
+    void queue(QOpenGLFramebufferObject *fbo, const QSize &size, quint64 frame = 0,
+               bool converted = false);
+
+    // 取出最新一个已完成的帧，更早完成的帧直接丢弃
+    // wait为true时，若没有完成的帧则阻塞等待最早的那一帧
+    // 映射PBO失败时返回false，image可能已被改写，不能当作新帧发布；占用的槽照样释放
+    bool takeLatest(QImage *image, bool wait, quint64 *frame = nullptr);
+
+    bool hasPending() const { return m_pending > 0; }
+
+private:
+    struct Slot {
+        GLuint pbo = 0;
+        GLsync fence = nullptr;
+        QSize size;
+        int bytes = 0;
+        quint64 frame = 0;
+        bool converted = false;
+    };
+
+    bool isSignaled(Slot &slot, bool wait);
+    void release(Slot &slot);
+    bool mapInto(Slot &slot, QImage *image);
+
+    QOpenGLContext *m_context = nullptr;
+    QVector<Slot> m_slots;
+    int m_head = 0;     // 下一个写入的位置
+    int m_pending = 0;  // 已发起但还没取走的帧数
+    bool m_supported = false;
+};
+
+}
+
+#endif // ZFRAMEREADBACK_H
@@ -0,0 +1,187 @@
+﻿#include "zframerecorder.h"
+#include "zpixelconvert.h"
+
+#include <QThread>
+#include <QDebug>
+
+using namespace ZQuick;
+
+FrameRecorder::FrameRecorder()
+    : m_format(Y4m),
+    m_fps(30),
+    m_queueLimit(8),
+    m_dropPolicy(DropOldest),
+    m_stopping(false),
+    m_recording(0),
+    m_thread(nullptr),
+    m_startNs(-1)
+{
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    stop();
+}
+
+bool FrameRecorder::start(const QString &fileName)
+{
+    if (m_thread) {
+        qWarning("FrameRecorder: already recording");
+        return false;
+    }
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "FrameRecorder: cannot write" << fileName << m_file.errorString();
+        return false;
+    }
+
+    m_size = QSize();
+    m_startNs = -1;
+    m_stopping = false;
+    m_queue.clear();
+    m_written.storeRelaxed(0);
+    m_dropped.storeRelaxed(0);
+
+    m_thread = QThread::create([this] { writerLoop(); });
+    m_thread->setObjectName(QStringLiteral("ZQuickRecorder"));
+    m_thread->start(QThread::LowPriority);
+    m_recording.storeRelease(1);
+    return true;
+}
+
+void FrameRecorder::stop()
+{
+    if (!m_thread)
+        return;
+
+    m_recording.storeRelease(0);
+    {
+        QMutexLocker lock(&m_mutex);
+        m_stopping = true;
+        m_cond.wakeOne();
+    }
+
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+    m_file.close();
+}
+
+void FrameRecorder::frameReady(const QImage &image, quint64 sequence, qint64 timestampNs)
+{
+    if (!isRecording())
+        return;
+
+    // 这里只持有很短时间的锁，不会等写线程
+    QMutexLocker lock(&m_mutex);
+    if (m_queue.size() >= m_queueLimit) {
+        m_dropped.ref();
+        if (m_dropPolicy == DropNewest)
+            return;
+        m_queue.dequeue();
+    }
+    m_queue.enqueue({image, sequence, timestampNs});
+    m_cond.wakeOne();
+}
+
+void FrameRecorder::writerLoop()
+{
+    for (;;) {
+        Item item;
+        {
+            QMutexLocker lock(&m_mutex);
+            while (m_queue.isEmpty() && !m_stopping)
+                m_cond.wait(&m_mutex);
+            // 停止时也要把已经排队的帧写完
+            if (m_queue.isEmpty())
+                return;
+            item = m_queue.dequeue();
+        }
+
+        if (writeFrame(item)) {
+            m_written.ref();
+        } else {
+            qWarning() << "FrameRecorder: write failed" << m_file.errorString();
+            m_recording.storeRelease(0);
+            QMutexLocker lock(&m_mutex);
+            m_queue.clear();
+            return;
+        }
+    }
+}
+
+QImage FrameRecorder::normalize(const QImage &image, bool *bgra)
+{
+    // 读回的帧是ARGB32_Premultiplied，小端机器上内存中按B、G、R、A排列，
+    // 调用者能处理这种顺序时（bgra不为空）直接用，省掉整幅的格式转换
+    if (bgra) {
+        *bgra = false;
+        if (Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+                && (image.format() == QImage::Format_ARGB32_Premultiplied
+                    || image.format() == QImage::Format_ARGB32
+                    || image.format() == QImage::Format_RGB32))
+            *bgra = true;
+    }
+
+    // 内存中按R、G、B、A排列，两种格式都可以直接用
+    QImage rgba = image;
+    if ((!bgra || !*bgra)
+            && image.format() != QImage::Format_RGBA8888_Premultiplied
+            && image.format() != QImage::Format_RGBA8888
+            && image.format() != QImage::Format_RGBX8888)
+        rgba = image.convertToFormat(QImage::Format_RGBA8888_Premultiplied);
+
+    // 尺寸以第一帧为准，之后尺寸不同的帧裁剪或补黑边
+    if (rgba.size() != m_size)
+        rgba = rgba.copy(QRect(QPoint(0, 0), m_size));
+    return rgba;
+}
+
+bool FrameRecorder::writeFrame(const Item &item)
+{
+    if (!m_size.isValid()) {
+        m_size = item.image.size();
+        m_startNs = item.timestampNs;
+
+        if (m_format == Y4m) {
+            const QByteArray header = QStringLiteral("YUV4MPEG2 W%1 H%2 F%3:1 Ip A1:1 C420jpeg\n")
+                    .arg(m_size.width()).arg(m_size.height()).arg(m_fps).toLatin1();
+            if (m_file.write(header) != header.size())
+                return false;
+        }
+    }
+
+    bool bgra = false;
+    const QImage rgba = normalize(item.image, m_format == Y4m ? &bgra : nullptr);
+    const int width = m_size.width();
+    const int height = m_size.height();
+
+    if (m_format == RawRgba) {
+        for (int y = 0; y < height; ++y) {
+            const char *line = reinterpret_cast<const char *>(rgba.constScanLine(y));
+            if (m_file.write(line, width * 4) != width * 4)
+                return false;
+        }
+        return true;
+    }
+
+    const int chromaWidth = (width + 1) / 2;
+    const int chromaHeight = (height + 1) / 2;
+    const int ySize = width * height;
+    const int cSize = chromaWidth * chromaHeight;
+    m_yuv.resize(ySize + 2 * cSize);
+
+    uchar *yPlane = reinterpret_cast<uchar *>(m_yuv.data());
+    if (bgra)
+        PixelConvert::bgraToI420(rgba.constBits(), rgba.bytesPerLine(), width, height,
+                                 yPlane, width, yPlane + ySize, yPlane + ySize + cSize, chromaWidth);
+    else
+        PixelConvert::rgbaToI420(rgba.constBits(), rgba.bytesPerLine(), width, height,
+                                 yPlane, width, yPlane + ySize, yPlane + ySize + cSize, chromaWidth);
+
+    const QByteArray frameHeader = QByteArrayLiteral("FRAME Xts=")
+            + QByteArray::number((item.timestampNs - m_startNs) / 1000) + '\n';
+    return m_file.write(frameHeader) == frameHeader.size()
+            && m_file.write(m_yuv) == m_yuv.size();
+}
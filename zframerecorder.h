@@ -0,0 +1,97 @@
+﻿#ifndef ZFRAMERECORDER_H
+#define ZFRAMERECORDER_H
+
+#include <QFile>
+#include <QMutex>
+#include <QQueue>
+#include <QWaitCondition>
+#include <QAtomicInteger>
+
+#include "zframesink.h"
+
+QT_FORWARD_DECLARE_CLASS(QThread)
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+// 把投递的帧写入文件
+// 渲染线程只负责放进一个有上限的队列，格式转换和写文件都在单独的写线程上；
+// 队列满了按丢帧策略丢弃，渲染线程永远不会等磁盘
+class FrameRecorder : public FrameSink
+{
+public:
+    enum Format {
+        RawRgba,    // 逐帧的RGBA字节，没有文件头，尺寸以第一帧为准
+        Y4m         // YUV4MPEG2，I420，每帧带Xts=微秒时间戳，可直接用ffmpeg/mpv打开
+    };
+
+    enum DropPolicy {
+        DropOldest, // 丢掉队列里最旧的帧，保证最新画面
+        DropNewest  // 丢掉新来的帧，保证已排队的连续
+    };
+
+    FrameRecorder();
+    ~FrameRecorder() override;
+
+    // 以下设置在start()之前调用
+    void setFormat(Format format) { m_format = format; }
+    Format format() const { return m_format; }
+    // 写在Y4M文件头里的名义帧率，实际的时间以每帧的时间戳为准
+    void setFrameRate(int fps) { m_fps = qMax(1, fps); }
+    int frameRate() const { return m_fps; }
+    void setQueueLimit(int frames) { m_queueLimit = qMax(1, frames); }
+    int queueLimit() const { return m_queueLimit; }
+    void setDropPolicy(DropPolicy policy) { m_dropPolicy = policy; }
+    DropPolicy dropPolicy() const { return m_dropPolicy; }
+
+    bool start(const QString &fileName);
+    // 写完队列里剩下的帧再返回
+    void stop();
+    bool isRecording() const { return m_recording.loadAcquire(); }
+
+    quint64 writtenFrames() const { return m_written.loadRelaxed(); }
+    quint64 droppedFrames() const { return m_dropped.loadRelaxed(); }
+
+    void frameReady(const QImage &image, quint64 sequence, qint64 timestampNs) override;
+
+private:
+    Q_DISABLE_COPY(FrameRecorder)
+
+    struct Item {
+        QImage image;
+        quint64 sequence;
+        qint64 timestampNs;
+    };
+
+    void writerLoop();
+    bool writeFrame(const Item &item);
+    QImage normalize(const QImage &image, bool *bgra = nullptr);
+
+    Format m_format;
+    int m_fps;
+    int m_queueLimit;
+    DropPolicy m_dropPolicy;
+
+    QMutex m_mutex;
+    QWaitCondition m_cond;
+    QQueue<Item> m_queue;
+    bool m_stopping;
+    QAtomicInt m_recording;
+
+    // 以下只在写线程上访问
+    QThread *m_thread;
+    QFile m_file;
+    QSize m_size;
+    qint64 m_startNs;
+    QByteArray m_yuv;
+
+    QAtomicInteger<quint64> m_written;
+    QAtomicInteger<quint64> m_dropped;
+};
+
+}
+
+#endif // ZFRAMERECORDER_H
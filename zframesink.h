@@ -0,0 +1,26 @@
+﻿#ifndef ZFRAMESINK_H
+#define ZFRAMESINK_H
+
+#include <QImage>
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+// 渲染线程投递每一帧时额外通知的接收者（录制、推流等）
+// frameReady()在渲染线程上调用，不能阻塞，耗时的工作要放到自己的线程里；
+// image是隐式共享的副本，可以直接保存，不会被渲染线程改写
+class FrameSink
+{
+public:
+    virtual ~FrameSink() {}
+
+    // timestampNs与FrameTimings::now()是同一个时钟
+    virtual void frameReady(const QImage &image, quint64 sequence, qint64 timestampNs) = 0;
+};
+
+}
+
+#endif // ZFRAMESINK_H
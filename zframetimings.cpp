@@ -0,0 +1,205 @@
+﻿#include "zframetimings.h"
+
+#include <QElapsedTimer>
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QFile>
+#include <QDebug>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+using namespace ZQuick;
+
+FrameTimings::FrameTimings(int capacity)
+{
+    // 取不小于capacity的2的幂，下标用位与计算
+    quint64 size = 16;
+    while (size < quint64(qMax(capacity, 16)))
+        size <<= 1;
+
+    m_slots = new Slot[size];
+    m_mask = size - 1;
+}
+
+FrameTimings::~FrameTimings()
+{
+    delete [] m_slots;
+}
+
+qint64 FrameTimings::now()
+{
+    static const QElapsedTimer clock = [] {
+        QElapsedTimer t;
+        t.start();
+        return t;
+    }();
+    return clock.nsecsElapsed();
+}
+
+const char *FrameTimings::phaseName(Phase phase)
+{
+    switch (phase) {
+    case Polish:   return "polish";
+    case SyncWait: return "syncWait";
+    case Sync:     return "sync";
+    case Render:   return "render";
+    case Readback: return "readback";
+    case Deliver:  return "deliver";
+    case Paint:    return "paint";
+    default:       return "unknown";
+    }
+}
+
+void FrameTimings::record(Phase phase, quint64 frame, qint64 startNs, qint64 endNs)
+{
+    const quint64 index = m_head.fetchAndAddRelaxed(1);
+    Slot &slot = m_slots[index & m_mask];
+
+    // seqlock：奇数表示正在写。release栅栏保证读端看到新数据之前一定先看到奇数版本号，
+    // storeRelease只约束它前面的写，拦不住后面的数据写被提前（ARM等弱内存序的CPU上会发生）
+    slot.version.storeRelaxed(index * 2 + 1);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.frame.storeRelaxed(frame);
+    slot.startNs.storeRelaxed(startNs);
+    slot.endNs.storeRelaxed(endNs);
+    slot.phase.storeRelaxed(phase);
+    slot.version.storeRelease(index * 2 + 2);
+}
+
+QVector<FrameTimings::Sample> FrameTimings::samples() const
+{
+    const quint64 head = m_head.loadAcquire();
+    const quint64 size = m_mask + 1;
+    const quint64 first = head > size ? head - size : 0;
+
+    QVector<Sample> result;
+    result.reserve(int(head - first));
+
+    for (quint64 i = first; i < head; ++i) {
+        const Slot &slot = m_slots[i & m_mask];
+
+        // 版本号对不上说明正在写或者已经被更新的记录覆盖了
+        const quint64 v = slot.version.loadAcquire();
+        if (v != i * 2 + 2)
+            continue;
+
+        Sample s;
+        s.frame = slot.frame.loadRelaxed();
+        s.startNs = slot.startNs.loadRelaxed();
+        s.endNs = slot.endNs.loadRelaxed();
+        s.phase = Phase(slot.phase.loadRelaxed());
+
+        // acquire栅栏让上面读数据不会被推迟到再次检查版本号之后
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.version.loadRelaxed() != v)
+            continue;
+        result.append(s);
+    }
+
+    return result;
+}
+
+qint64 FrameTimings::percentile(Phase phase, double p) const
+{
+    QVector<qint64> durations;
+    const QVector<Sample> all = samples();
+    for (const Sample &s : all) {
+        if (s.phase == phase)
+            durations.append((s.endNs - s.startNs) / 1000);
+    }
+
+    if (durations.isEmpty())
+        return -1;
+
+    const int n = durations.size();
+    const int k = qBound(0, int(std::ceil(p / 100.0 * n)) - 1, n - 1);
+    std::nth_element(durations.begin(), durations.begin() + k, durations.end());
+    return durations.at(k);
+}
+
+FrameTimings::Summary FrameTimings::summary(Phase phase) const
+{
+    QVector<qint64> durations;
+    const QVector<Sample> all = samples();
+    for (const Sample &s : all) {
+        if (s.phase == phase)
+            durations.append((s.endNs - s.startNs) / 1000);
+    }
+
+    Summary r;
+    r.count = durations.size();
+    if (durations.isEmpty())
+        return r;
+
+    std::sort(durations.begin(), durations.end());
+    auto at = [&](double p) {
+        const int k = qBound(0, int(std::ceil(p / 100.0 * r.count)) - 1, r.count - 1);
+        return durations.at(k);
+    };
+    r.p50 = at(50);
+    r.p90 = at(90);
+    r.p99 = at(99);
+    r.max = durations.last();
+    return r;
+}
+
+QByteArray FrameTimings::toChromeTrace() const
+{
+    // ui线程、渲染线程、投递各占一条泳道
+    enum { GuiLane = 1, RenderLane = 2, DeliverLane = 3 };
+    const qint64 pid = QCoreApplication::applicationPid();
+
+    QJsonArray events;
+
+    auto laneName = [&](int tid, const char *name) {
+        QJsonObject e;
+        e.insert(QStringLiteral("name"), QStringLiteral("thread_name"));
+        e.insert(QStringLiteral("ph"), QStringLiteral("M"));
+        e.insert(QStringLiteral("pid"), pid);
+        e.insert(QStringLiteral("tid"), tid);
+        e.insert(QStringLiteral("args"), QJsonObject{{QStringLiteral("name"), QLatin1String(name)}});
+        events.append(e);
+    };
+    laneName(GuiLane, "GUI");
+    laneName(RenderLane, "Render");
+    laneName(DeliverLane, "Deliver");
+
+    const QVector<Sample> all = samples();
+    for (const Sample &s : all) {
+        int tid = RenderLane;
+        if (s.phase == Polish || s.phase == SyncWait || s.phase == Paint)
+            tid = GuiLane;
+        else if (s.phase == Deliver)
+            tid = DeliverLane;
+
+        QJsonObject e;
+        e.insert(QStringLiteral("name"), QLatin1String(phaseName(s.phase)));
+        e.insert(QStringLiteral("cat"), QStringLiteral("frame"));
+        e.insert(QStringLiteral("ph"), QStringLiteral("X"));
+        e.insert(QStringLiteral("ts"), s.startNs / 1000.0);
+        e.insert(QStringLiteral("dur"), (s.endNs - s.startNs) / 1000.0);
+        e.insert(QStringLiteral("pid"), pid);
+        e.insert(QStringLiteral("tid"), tid);
+        e.insert(QStringLiteral("args"), QJsonObject{{QStringLiteral("frame"), qint64(s.frame)}});
+        events.append(e);
+    }
+
+    QJsonObject root;
+    root.insert(QStringLiteral("traceEvents"), events);
+    root.insert(QStringLiteral("displayTimeUnit"), QStringLiteral("ms"));
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+bool FrameTimings::writeChromeTrace(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "FrameTimings: cannot write" << fileName << file.errorString();
+        return false;
+    }
+    return file.write(toChromeTrace()) >= 0;
+}
@@ -0,0 +1,105 @@
+﻿#ifndef ZFRAMETIMINGS_H
+#define ZFRAMETIMINGS_H
+
+#include <QAtomicInteger>
+#include <QVector>
+#include <QByteArray>
+#include <QString>
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+// 每个控件一份的帧阶段耗时记录
+// 固定大小的环形缓冲，任意线程无锁写入，写满后覆盖最旧的记录；
+// 平时一直开着，需要时再取百分位数或导出Chrome trace（Perfetto也能打开）
+class FrameTimings
+{
+public:
+    enum Phase {
+        Polish,     // ui线程：polishItems
+        SyncWait,   // ui线程：从请求sync到被唤醒
+        Sync,       // 渲染线程：QQuickRenderControl::sync
+        Render,     // 渲染线程：QQuickRenderControl::render
+        Readback,   // 渲染线程：读回/交付纹理
+        Deliver,    // 从渲染线程投递到ui线程取走
+        Paint,      // ui线程：paintEvent
+        PhaseCount
+    };
+
+    explicit FrameTimings(int capacity = 4096);
+    ~FrameTimings();
+
+    // 进程内统一的单调时钟，单位纳秒
+    static qint64 now();
+    static const char *phaseName(Phase phase);
+
+    void record(Phase phase, quint64 frame, qint64 startNs, qint64 endNs);
+
+    struct Sample {
+        Phase phase;
+        quint64 frame;
+        qint64 startNs;
+        qint64 endNs;
+    };
+    // 按写入顺序返回当前缓冲里完整的记录
+    QVector<Sample> samples() const;
+
+    // p取0~100，单位微秒；没有记录时返回-1
+    qint64 percentile(Phase phase, double p) const;
+
+    struct Summary {
+        int count = 0;
+        qint64 p50 = -1;
+        qint64 p90 = -1;
+        qint64 p99 = -1;
+        qint64 max = -1;
+    };
+    Summary summary(Phase phase) const;
+
+    QByteArray toChromeTrace() const;
+    bool writeChromeTrace(const QString &fileName) const;
+
+    // 在作用域结束时记录一次
+    class Scope
+    {
+    public:
+        Scope(FrameTimings *timings, Phase phase, quint64 frame)
+            : m_timings(timings), m_phase(phase), m_frame(frame),
+            m_start(timings ? now() : 0) {}
+        ~Scope()
+        {
+            if (m_timings)
+                m_timings->record(m_phase, m_frame, m_start, now());
+        }
+
+    private:
+        Q_DISABLE_COPY(Scope)
+        FrameTimings *m_timings;
+        Phase m_phase;
+        quint64 m_frame;
+        qint64 m_start;
+    };
+
+private:
+    Q_DISABLE_COPY(FrameTimings)
+
+    // 每个槽位是一个小的seqlock：写入时版本号为奇数，写完为偶数
+    struct Slot {
+        QAtomicInteger<quint64> version;
+        QAtomicInteger<quint64> frame;
+        QAtomicInteger<qint64> startNs;
+        QAtomicInteger<qint64> endNs;
+        QAtomicInt phase;
+    };
+
+    Slot *m_slots;
+    quint64 m_mask;
+    QAtomicInteger<quint64> m_head;
+};
+
+}
+
+#endif // ZFRAMETIMINGS_H
@@ -0,0 +1,164 @@
+﻿#include "zglpresenter.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+#include <QCoreApplication>
+#include <QVector2D>
+
+using namespace ZQuick;
+
+GlPresenter::GlPresenter(TextureMailbox *mailbox, QWidget *parent)
+    : QOpenGLWidget(parent),
+    m_mailbox(mailbox),
+    m_program(nullptr),
+    m_vbo(nullptr),
+    m_vao(nullptr),
+    m_hasSync(false),
+    m_timings(nullptr),
+    m_presented(0)
+{
+    // 鼠标事件交给外层的ZQuickWidget处理
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+}
+
+GlPresenter::~GlPresenter()
+{
+    makeCurrent();
+    cleanupGL();
+    doneCurrent();
+}
+
+bool GlPresenter::isAvailable()
+{
+    return QCoreApplication::testAttribute(Qt::AA_ShareOpenGLContexts)
+            && QOpenGLContext::globalShareContext();
+}
+
+void GlPresenter::initializeGL()
+{
+    connect(context(), &QOpenGLContext::aboutToBeDestroyed, this, &GlPresenter::cleanupGL);
+
+    const QSurfaceFormat fmt = context()->format();
+    if (context()->isOpenGLES())
+        m_hasSync = fmt.majorVersion() >= 3;
+    else
+        m_hasSync = fmt.version() >= qMakePair(3, 2)
+                || (fmt.version() >= qMakePair(3, 0) && context()->hasExtension("GL_ARB_sync"));
+
+    // 与PlaneRenderer相同的贴图四边形
+    static const char *vertexShaderSource =
+        "attribute highp vec4 vertex;\n"
+        "attribute lowp vec2 coord;\n"
+        "varying mediump vec2 v_coord;\n"
+        "uniform highp vec2 coordScale;\n"
+        "void main() {\n"
+        "   v_coord = coord * coordScale;\n"
+        "   gl_Position = vertex;\n"
+        "}\n";
+    static const char *fragmentShaderSource =
+        "varying mediump vec2 v_coord;\n"
+        "uniform sampler2D sampler;\n"
+        "void main() {\n"
+        "   gl_FragColor = texture2D(sampler, v_coord);\n"
+        "}\n";
+
+    m_program = new QOpenGLShaderProgram;
+    m_program->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSource);
+    m_program->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderSource);
+    m_program->bindAttributeLocation("vertex", 0);
+    m_program->bindAttributeLocation("coord", 1);
+    m_program->link();
+
+    // x, y, u, v，按三角形带排列
+    static const GLfloat v[] = {
+        -1.0f, -1.0f, 0.0f, 0.0f,
+         1.0f, -1.0f, 1.0f, 0.0f,
+        -1.0f,  1.0f, 0.0f, 1.0f,
+         1.0f,  1.0f, 1.0f, 1.0f
+    };
+
+    m_vao = new QOpenGLVertexArrayObject;
+    m_vao->create();
+    QOpenGLVertexArrayObject::Binder vaoBinder(m_vao);
+
+    m_vbo = new QOpenGLBuffer;
+    m_vbo->create();
+    m_vbo->bind();
+    m_vbo->allocate(v, sizeof(v));
+
+    QOpenGLFunctions *f = context()->functions();
+    m_program->enableAttributeArray(0);
+    m_program->enableAttributeArray(1);
+    f->glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), nullptr);
+    f->glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat),
+                             reinterpret_cast<const void *>(2 * sizeof(GLfloat)));
+    m_vbo->release();
+}
+
+void GlPresenter::paintGL()
+{
+    QOpenGLExtraFunctions *f = context()->extraFunctions();
+    f->glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    f->glClear(GL_COLOR_BUFFER_BIT);
+
+    const bool fresh = m_mailbox->consume();
+    TextureFrame &frame = m_mailbox->readSlot();
+    if (!frame.fbo || !m_program)
+        return;
+
+    if (fresh && m_timings)
+        m_timings->record(FrameTimings::Deliver, frame.sequence, frame.publishedNs, FrameTimings::now());
+    FrameTimings::Scope paintScope(m_timings, FrameTimings::Paint, frame.sequence);
+    m_presented = frame.sequence;
+
+    // 让GPU等渲染线程那边画完再采样，CPU这边不会阻塞
+    if (frame.fence) {
+        if (m_hasSync)
+            f->glWaitSync(frame.fence, 0, GL_TIMEOUT_IGNORED);
+        f->glDeleteSync(frame.fence);
+        frame.fence = nullptr;
+    }
+
+    f->glDisable(GL_BLEND);
+    f->glDisable(GL_DEPTH_TEST);
+    f->glActiveTexture(GL_TEXTURE0);
+    f->glBindTexture(GL_TEXTURE_2D, frame.fbo->texture());
+
+    m_program->bind();
+    m_program->setUniformValue("sampler", 0);
+    // fbo按档分配，只采样其中有内容的部分
+    const QSize fboSize = frame.fbo->size();
+    const QSize size = frame.size.isEmpty() ? fboSize : frame.size;
+    m_program->setUniformValue("coordScale", QVector2D(float(size.width()) / fboSize.width(),
+                                                        float(size.height()) / fboSize.height()));
+    {
+        QOpenGLVertexArrayObject::Binder vaoBinder(m_vao);
+        if (!m_vao->isCreated()) {
+            m_vbo->bind();
+            m_program->enableAttributeArray(0);
+            m_program->enableAttributeArray(1);
+            f->glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), nullptr);
+            f->glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat),
+                                     reinterpret_cast<const void *>(2 * sizeof(GLfloat)));
+        }
+        f->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        if (!m_vao->isCreated())
+            m_vbo->release();
+    }
+    m_program->release();
+    f->glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void GlPresenter::cleanupGL()
+{
+    delete m_program;
+    m_program = nullptr;
+    delete m_vbo;
+    m_vbo = nullptr;
+    delete m_vao;
+    m_vao = nullptr;
+}
@@ -0,0 +1,68 @@
+﻿#ifndef ZGLPRESENTER_H
+#define ZGLPRESENTER_H
+
+#include <QOpenGLWidget>
+#include <qopengl.h>
+
+#include "zframemailbox.h"
+#include "zframetimings.h"
+
+QT_FORWARD_DECLARE_CLASS(QOpenGLFramebufferObject)
+QT_FORWARD_DECLARE_CLASS(QOpenGLShaderProgram)
+QT_FORWARD_DECLARE_CLASS(QOpenGLBuffer)
+QT_FORWARD_DECLARE_CLASS(QOpenGLVertexArrayObject)
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+// 渲染线程直接渲染到这里的fbo，ui线程直接采样其纹理，不经过CPU
+struct TextureFrame
+{
+    QOpenGLFramebufferObject *fbo = nullptr;
+    GLsync fence = nullptr;     // 渲染完成的fence，由消费者等待并删除
+    QSize size;                 // 有效内容的尺寸，位于fbo左下角，fbo本身可能更大
+    quint64 sequence = 0;
+    qint64 publishedNs = 0;
+};
+
+typedef FrameMailbox<TextureFrame> TextureMailbox;
+
+// 与渲染线程的上下文处于同一个共享组的QOpenGLWidget
+// 需要在创建QApplication之前设置Qt::AA_ShareOpenGLContexts
+class GlPresenter : public QOpenGLWidget
+{
+    Q_OBJECT
+
+public:
+    explicit GlPresenter(TextureMailbox *mailbox, QWidget *parent = nullptr);
+    ~GlPresenter();
+
+    // 能否与渲染线程共享纹理
+    static bool isAvailable();
+
+    void setFrameTimings(FrameTimings *timings) { m_timings = timings; }
+    // 最近一次画出的帧序号，frameSwapped之后读取
+    quint64 presentedSequence() const { return m_presented; }
+
+protected:
+    void initializeGL() override;
+    void paintGL() override;
+
+private:
+    void cleanupGL();
+
+    TextureMailbox *m_mailbox;
+    QOpenGLShaderProgram *m_program;
+    QOpenGLBuffer *m_vbo;
+    QOpenGLVertexArrayObject *m_vao;
+    bool m_hasSync;
+    FrameTimings *m_timings;
+    quint64 m_presented;
+};
+
+}
+
+#endif // ZGLPRESENTER_H
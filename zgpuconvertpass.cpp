@@ -0,0 +1,164 @@
+﻿#include "zgpuconvertpass.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+#include <QVector2D>
+#include <QDebug>
+
+using namespace ZQuick;
+
+GpuConvertPass::GpuConvertPass()
+    : m_context(nullptr),
+    m_program(nullptr),
+    m_vbo(nullptr),
+    m_vao(nullptr),
+    m_target(nullptr)
+{
+}
+
+GpuConvertPass::~GpuConvertPass()
+{
+    // cleanup()需要current的上下文，只能由使用者在渲染线程里调用
+    Q_ASSERT(!m_program);
+}
+
+bool GpuConvertPass::initialize(QOpenGLContext *ctx)
+{
+    m_context = ctx;
+
+    // 纹理坐标上下翻转，并只采样有内容的那一块
+    static const char *vertexShaderSource =
+        "attribute highp vec4 vertex;\n"
+        "attribute mediump vec2 coord;\n"
+        "varying mediump vec2 v_coord;\n"
+        "uniform highp vec2 coordScale;\n"
+        "void main() {\n"
+        "   v_coord = vec2(coord.x, 1.0 - coord.y) * coordScale;\n"
+        "   gl_Position = vertex;\n"
+        "}\n";
+
+    // 用GL_RGBA读出时，字节顺序就是ARGB32在内存中的顺序：
+    // 小端为B、G、R、A，大端为A、R、G、B
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    static const char *fragmentShaderSource =
+        "varying mediump vec2 v_coord;\n"
+        "uniform sampler2D sampler;\n"
+        "void main() {\n"
+        "   gl_FragColor = texture2D(sampler, v_coord).bgra;\n"
+        "}\n";
+#else
+    static const char *fragmentShaderSource =
+        "varying mediump vec2 v_coord;\n"
+        "uniform sampler2D sampler;\n"
+        "void main() {\n"
+        "   gl_FragColor = texture2D(sampler, v_coord).argb;\n"
+        "}\n";
+#endif
+
+    m_program = new QOpenGLShaderProgram;
+    m_program->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSource);
+    m_program->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderSource);
+    m_program->bindAttributeLocation("vertex", 0);
+    m_program->bindAttributeLocation("coord", 1);
+    if (!m_program->link()) {
+        qWarning() << "GpuConvertPass: failed to link shader" << m_program->log();
+        delete m_program;
+        m_program = nullptr;
+        return false;
+    }
+
+    // x, y, u, v，按三角形带排列
+    static const GLfloat v[] = {
+        -1.0f, -1.0f, 0.0f, 0.0f,
+         1.0f, -1.0f, 1.0f, 0.0f,
+        -1.0f,  1.0f, 0.0f, 1.0f,
+         1.0f,  1.0f, 1.0f, 1.0f
+    };
+
+    m_vao = new QOpenGLVertexArrayObject;
+    m_vao->create();
+    QOpenGLVertexArrayObject::Binder vaoBinder(m_vao);
+
+    m_vbo = new QOpenGLBuffer;
+    m_vbo->create();
+    m_vbo->bind();
+    m_vbo->allocate(v, sizeof(v));
+    m_vbo->release();
+
+    if (m_vao->isCreated())
+        setupVertexAttribs();
+
+    return true;
+}
+
+void GpuConvertPass::cleanup()
+{
+    delete m_target;
+    m_target = nullptr;
+    delete m_program;
+    m_program = nullptr;
+    delete m_vbo;
+    m_vbo = nullptr;
+    delete m_vao;
+    m_vao = nullptr;
+    m_context = nullptr;
+}
+
+void GpuConvertPass::setupVertexAttribs()
+{
+    QOpenGLFunctions *f = m_context->functions();
+    m_vbo->bind();
+    m_program->enableAttributeArray(0);
+    m_program->enableAttributeArray(1);
+    f->glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), nullptr);
+    f->glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat),
+                             reinterpret_cast<const void *>(2 * sizeof(GLfloat)));
+    m_vbo->release();
+}
+
+QOpenGLFramebufferObject *GpuConvertPass::convert(QOpenGLFramebufferObject *scene, const QSize &size)
+{
+    if (!m_program || size.isEmpty())
+        return nullptr;
+
+    // 读出时要求紧密排列，目标fbo的尺寸必须正好是size；只有颜色，没有深度
+    if (m_target && m_target->size() != size) {
+        delete m_target;
+        m_target = nullptr;
+    }
+    if (!m_target)
+        m_target = new QOpenGLFramebufferObject(size);
+
+    QOpenGLFunctions *f = m_context->functions();
+    m_target->bind();
+    f->glViewport(0, 0, size.width(), size.height());
+    f->glDisable(GL_BLEND);
+    f->glDisable(GL_DEPTH_TEST);
+    f->glDisable(GL_STENCIL_TEST);
+    f->glDisable(GL_SCISSOR_TEST);
+    f->glDisable(GL_CULL_FACE);
+    f->glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    f->glActiveTexture(GL_TEXTURE0);
+    f->glBindTexture(GL_TEXTURE_2D, scene->texture());
+
+    m_program->bind();
+    m_program->setUniformValue("sampler", 0);
+    const QSize sceneSize = scene->size();
+    m_program->setUniformValue("coordScale", QVector2D(float(size.width()) / sceneSize.width(),
+                                                        float(size.height()) / sceneSize.height()));
+    {
+        QOpenGLVertexArrayObject::Binder vaoBinder(m_vao);
+        if (!m_vao->isCreated())
+            setupVertexAttribs();
+        f->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    }
+    m_program->release();
+    f->glBindTexture(GL_TEXTURE_2D, 0);
+
+    return m_target;
+}
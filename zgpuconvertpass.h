@@ -0,0 +1,51 @@
+﻿#ifndef ZGPUCONVERTPASS_H
+#define ZGPUCONVERTPASS_H
+
+#include <QSize>
+
+QT_FORWARD_DECLARE_CLASS(QOpenGLContext)
+QT_FORWARD_DECLARE_CLASS(QOpenGLFramebufferObject)
+QT_FORWARD_DECLARE_CLASS(QOpenGLShaderProgram)
+QT_FORWARD_DECLARE_CLASS(QOpenGLBuffer)
+QT_FORWARD_DECLARE_CLASS(QOpenGLVertexArrayObject)
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+// 在GPU上把场景的fbo画到另一个fbo里：上下翻转，并按QImage::Format_ARGB32_Premultiplied
+// 在内存中的字节顺序排列通道，之后用GL_RGBA读出来的数据可以直接memcpy进QImage，
+// CPU不用再翻转、换通道。贴图四边形的着色器与PlaneRenderer相同
+// 所有函数都必须在渲染线程、且上下文为current时调用
+class GpuConvertPass
+{
+public:
+    GpuConvertPass();
+    ~GpuConvertPass();
+
+    bool initialize(QOpenGLContext *ctx);
+    void cleanup();
+
+    bool isSupported() const { return m_program != nullptr; }
+
+    // scene左下角size大小的区域是有效内容；返回的fbo尺寸正好是size，
+    // 下一次调用之前一直有效
+    QOpenGLFramebufferObject *convert(QOpenGLFramebufferObject *scene, const QSize &size);
+
+private:
+    Q_DISABLE_COPY(GpuConvertPass)
+
+    void setupVertexAttribs();
+
+    QOpenGLContext *m_context;
+    QOpenGLShaderProgram *m_program;
+    QOpenGLBuffer *m_vbo;
+    QOpenGLVertexArrayObject *m_vao;
+    QOpenGLFramebufferObject *m_target;
+};
+
+}
+
+#endif // ZGPUCONVERTPASS_H
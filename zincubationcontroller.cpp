@@ -0,0 +1,43 @@
+﻿#include "zincubationcontroller.h"
+
+#include <QQmlEngine>
+
+using namespace ZQuick;
+
+IncubationController::IncubationController(QQmlEngine *engine)
+    : QObject(engine),
+    m_budget(5)
+{
+    m_timer.setInterval(16);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &IncubationController::tick);
+}
+
+IncubationController *IncubationController::forEngine(QQmlEngine *engine)
+{
+    IncubationController *controller = engine->findChild<IncubationController *>(QString(), Qt::FindDirectChildrenOnly);
+    if (controller)
+        return controller;
+
+    if (engine->incubationController())
+        return nullptr;
+
+    controller = new IncubationController(engine);
+    engine->setIncubationController(controller);
+    return controller;
+}
+
+void IncubationController::incubatingObjectCountChanged(int count)
+{
+    // 没有要创建的对象时不空转
+    if (count > 0 && !m_timer.isActive())
+        m_timer.start();
+    else if (count == 0)
+        m_timer.stop();
+}
+
+void IncubationController::tick()
+{
+    incubateFor(m_budget);
+    emit incubated(incubatingObjectCount());
+}
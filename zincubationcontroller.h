@@ -0,0 +1,83 @@
+﻿#ifndef ZINCUBATIONCONTROLLER_H
+#define ZINCUBATIONCONTROLLER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QQmlIncubator>
+#include <functional>
+
+QT_FORWARD_DECLARE_CLASS(QQmlEngine)
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+// 用定时器驱动的异步创建控制器
+// QQuickWindow自带的控制器靠窗口的渲染循环驱动，离屏窗口没有渲染循环，异步创建永远不会推进；
+// 这里每隔interval毫秒在ui线程上执行一次，每次最多花budget毫秒，其余时间ui线程照常处理事件。
+// 一个engine一个，是engine的子对象；只能在engine所在线程使用
+class IncubationController : public QObject, public QQmlIncubationController
+{
+    Q_OBJECT
+
+public:
+    // engine已经装了别的控制器时不替换，返回nullptr
+    static IncubationController *forEngine(QQmlEngine *engine);
+
+    // 每次最多用于创建对象的时间，默认5ms
+    void setBudget(int msecs) { m_budget = qMax(1, msecs); }
+    int budget() const { return m_budget; }
+
+    // 两次之间的间隔，默认16ms（一帧）
+    void setInterval(int msecs) { m_timer.setInterval(qMax(0, msecs)); }
+    int interval() const { return m_timer.interval(); }
+
+signals:
+    // 每执行一次发出，remaining为还在创建中的对象数
+    void incubated(int remaining);
+
+protected:
+    void incubatingObjectCountChanged(int count) override;
+
+private:
+    explicit IncubationController(QQmlEngine *engine);
+    void tick();
+
+    QTimer m_timer;
+    int m_budget;
+};
+
+// 状态变化时回调的QQmlIncubator
+class Incubator : public QQmlIncubator
+{
+public:
+    using Callback = std::function<void(QQmlIncubator::Status)>;
+
+    explicit Incubator(IncubationMode mode = Asynchronous) : QQmlIncubator(mode) {}
+
+    // 对象已创建、还没有completed时调用，适合设置父item和尺寸，避免创建完再重新布局
+    void setInitialStateCallback(const std::function<void(QObject *)> &callback) { m_initialState = callback; }
+    void setStatusCallback(const Callback &callback) { m_status = callback; }
+
+protected:
+    void statusChanged(Status status) override
+    {
+        if (m_status)
+            m_status(status);
+    }
+    void setInitialState(QObject *object) override
+    {
+        if (m_initialState)
+            m_initialState(object);
+    }
+
+private:
+    Callback m_status;
+    std::function<void(QObject *)> m_initialState;
+};
+
+}
+
+#endif // ZINCUBATIONCONTROLLER_H
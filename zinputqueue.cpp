@@ -0,0 +1,119 @@
+﻿#include "zinputqueue.h"
+
+#include <QCoreApplication>
+#include <QMouseEvent>
+#include <QWheelEvent>
+#include <QTouchEvent>
+
+using namespace ZQuick;
+
+// 触摸点都只是移动或不动，没有按下、抬起
+static bool onlyMoved(const QTouchEvent *e)
+{
+    return !(e->touchPointStates() & (Qt::TouchPointPressed | Qt::TouchPointReleased));
+}
+
+static bool sameTouchPoints(const QTouchEvent *a, const QTouchEvent *b)
+{
+    const QList<QTouchEvent::TouchPoint> &pa = a->touchPoints();
+    const QList<QTouchEvent::TouchPoint> &pb = b->touchPoints();
+    if (pa.size() != pb.size())
+        return false;
+    for (int i = 0; i < pa.size(); ++i) {
+        if (pa.at(i).id() != pb.at(i).id())
+            return false;
+    }
+    return true;
+}
+
+InputQueue::InputQueue()
+{
+}
+
+InputQueue::~InputQueue()
+{
+    clear();
+}
+
+void InputQueue::post(QEvent *event)
+{
+    ++m_stats.received;
+
+    if (!m_events.isEmpty()) {
+        if (QEvent *merged = merge(m_events.last(), event)) {
+            delete m_events.last();
+            if (merged != event)
+                delete event;
+            m_events.last() = merged;
+            return;
+        }
+    }
+    m_events.append(event);
+}
+
+int InputQueue::deliver(QObject *receiver)
+{
+    // 投递过程中QML可能又触发新的输入（例如弹出菜单），先把队列换出来
+    const QVector<QEvent *> events = m_events;
+    m_events.clear();
+
+    for (QEvent *event : events) {
+        QCoreApplication::sendEvent(receiver, event);
+        delete event;
+    }
+
+    m_stats.delivered += quint64(events.size());
+    return events.size();
+}
+
+void InputQueue::clear()
+{
+    qDeleteAll(m_events);
+    m_events.clear();
+}
+
+// 返回合并后的事件（可以就是event本身），不能合并时返回nullptr
+QEvent *InputQueue::merge(QEvent *last, QEvent *event) const
+{
+    if (last->type() != event->type())
+        return nullptr;
+
+    switch (event->type()) {
+    case QEvent::MouseMove: {
+        const QMouseEvent *a = static_cast<const QMouseEvent *>(last);
+        const QMouseEvent *b = static_cast<const QMouseEvent *>(event);
+        if (a->buttons() != b->buttons() || a->modifiers() != b->modifiers() || a->source() != b->source())
+            return nullptr;
+        return event;
+    }
+    case QEvent::Wheel: {
+        const QWheelEvent *a = static_cast<const QWheelEvent *>(last);
+        const QWheelEvent *b = static_cast<const QWheelEvent *>(event);
+        if (a->buttons() != b->buttons() || a->modifiers() != b->modifiers()
+                || a->phase() != b->phase() || a->inverted() != b->inverted()
+                || a->source() != b->source())
+            return nullptr;
+        // 开始、结束这类阶段性的事件不合并
+        if (b->phase() != Qt::NoScrollPhase && b->phase() != Qt::ScrollUpdate)
+            return nullptr;
+
+        QWheelEvent *sum = new QWheelEvent(b->position(), b->globalPosition(),
+                                           a->pixelDelta() + b->pixelDelta(),
+                                           a->angleDelta() + b->angleDelta(),
+                                           b->buttons(), b->modifiers(), b->phase(),
+                                           b->inverted(), b->source());
+        sum->setTimestamp(b->timestamp());
+        return sum;
+    }
+    case QEvent::TouchUpdate: {
+        const QTouchEvent *a = static_cast<const QTouchEvent *>(last);
+        const QTouchEvent *b = static_cast<const QTouchEvent *>(event);
+        if (a->modifiers() != b->modifiers() || a->device() != b->device()
+                || !onlyMoved(a) || !onlyMoved(b) || !sameTouchPoints(a, b))
+            return nullptr;
+        return event;
+    }
+    default:
+        return nullptr;
+    }
+}
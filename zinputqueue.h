@@ -0,0 +1,51 @@
+﻿#ifndef ZINPUTQUEUE_H
+#define ZINPUTQUEUE_H
+
+#include <QVector>
+
+QT_FORWARD_DECLARE_CLASS(QEvent)
+QT_FORWARD_DECLARE_CLASS(QObject)
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+struct InputStats
+{
+    quint64 received = 0;   // 控件收到并转发的输入事件数
+    quint64 delivered = 0;  // 合并之后真正送到QQuickWindow的事件数
+};
+
+// 每帧一次的输入队列
+// 连续的鼠标移动只保留最后一个，连续的滚轮事件累加滚动量，连续的触摸移动只保留最后一个；
+// 按下、松开、按键、焦点等事件不合并，并且会打断前后的合并，整体顺序不变。
+// 由控件在polish之前统一投递，只能在ui线程使用
+class InputQueue
+{
+public:
+    InputQueue();
+    ~InputQueue();
+
+    // 接管event的所有权
+    void post(QEvent *event);
+    // 按顺序发送给receiver并清空队列，返回发送的个数
+    int deliver(QObject *receiver);
+    void clear();
+
+    bool isEmpty() const { return m_events.isEmpty(); }
+    InputStats stats() const { return m_stats; }
+
+private:
+    Q_DISABLE_COPY(InputQueue)
+
+    QEvent *merge(QEvent *last, QEvent *event) const;
+
+    QVector<QEvent *> m_events;
+    InputStats m_stats;
+};
+
+}
+
+#endif // ZINPUTQUEUE_H
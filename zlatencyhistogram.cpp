@@ -0,0 +1,98 @@
+﻿#include "zlatencyhistogram.h"
+
+#include <QtAlgorithms>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace ZQuick;
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+// 小于8的值每个值一个桶；之后[2^e, 2^(e+1))分成8个桶
+int LatencyHistogram::bucketOf(quint64 us)
+{
+    if (us < SubBuckets)
+        return int(us);
+
+    const int e = 63 - int(qCountLeadingZeroBits(us));
+    if (e >= MaxExponent)
+        return BucketCount - 1;
+
+    const int sub = int(us >> (e - 3)) & (SubBuckets - 1);
+    return SubBuckets + (e - 3) * SubBuckets + sub;
+}
+
+qint64 LatencyHistogram::upperOf(int bucket)
+{
+    if (bucket < SubBuckets)
+        return bucket;
+
+    const int e = (bucket - SubBuckets) / SubBuckets + 3;
+    const int sub = (bucket - SubBuckets) % SubBuckets;
+    return ((qint64(SubBuckets + sub + 1)) << (e - 3)) - 1;
+}
+
+void LatencyHistogram::record(qint64 us)
+{
+    us = qMax<qint64>(0, us);
+
+    ++m_counts[bucketOf(quint64(us))];
+    if (!m_count || us < m_min)
+        m_min = us;
+    if (!m_count || us > m_max)
+        m_max = us;
+    ++m_count;
+    m_sum += quint64(us);
+}
+
+void LatencyHistogram::reset()
+{
+    std::fill(m_counts, m_counts + BucketCount, quint64(0));
+    m_count = 0;
+    m_sum = 0;
+    m_min = 0;
+    m_max = 0;
+}
+
+qint64 LatencyHistogram::percentile(double p) const
+{
+    if (!m_count)
+        return -1;
+
+    const quint64 rank = qBound<quint64>(1, quint64(std::ceil(p / 100.0 * m_count)), m_count);
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += m_counts[i];
+        if (seen >= rank)
+            return qMin(upperOf(i), m_max);
+    }
+    return m_max;
+}
+
+QVector<LatencyHistogram::Bucket> LatencyHistogram::buckets() const
+{
+    QVector<Bucket> result;
+    for (int i = 0; i < BucketCount; ++i) {
+        if (m_counts[i])
+            result.append({upperOf(i), m_counts[i]});
+    }
+    return result;
+}
+
+QString LatencyHistogram::toString() const
+{
+    if (!m_count)
+        return QStringLiteral("n=0");
+
+    return QStringLiteral("n=%1 min=%2ms p50=%3ms p90=%4ms p99=%5ms max=%6ms")
+            .arg(m_count)
+            .arg(m_min / 1000.0, 0, 'f', 2)
+            .arg(percentile(50) / 1000.0, 0, 'f', 2)
+            .arg(percentile(90) / 1000.0, 0, 'f', 2)
+            .arg(percentile(99) / 1000.0, 0, 'f', 2)
+            .arg(m_max / 1000.0, 0, 'f', 2);
+}
@@ -0,0 +1,61 @@
+﻿#ifndef ZLATENCYHISTOGRAM_H
+#define ZLATENCYHISTOGRAM_H
+
+#include <QVector>
+#include <QString>
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+// 延迟直方图，单位微秒
+// 桶按对数划分：每个2的幂区间再均分成8份，相对误差不超过1/8；
+// 记录是O(1)的数组计数，不分配内存，适合一直开着。只能在一个线程里使用
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(qint64 us);
+    void reset();
+
+    quint64 count() const { return m_count; }
+    qint64 min() const { return m_count ? m_min : -1; }
+    qint64 max() const { return m_count ? m_max : -1; }
+    double mean() const { return m_count ? double(m_sum) / m_count : -1; }
+
+    // p取0~100，返回所在桶的上界（不超过max）；没有记录时返回-1
+    qint64 percentile(double p) const;
+
+    struct Bucket {
+        qint64 upperUs;     // 桶的上界，包含
+        quint64 count;
+    };
+    // 只返回有记录的桶，从小到大
+    QVector<Bucket> buckets() const;
+
+    // 一行摘要，方便打日志
+    QString toString() const;
+
+private:
+    enum {
+        SubBuckets = 8,
+        MaxExponent = 40,   // 2^40us，约12天，再大的值都算进最后一个桶
+        BucketCount = SubBuckets + (MaxExponent - 3) * SubBuckets
+    };
+
+    static int bucketOf(quint64 us);
+    static qint64 upperOf(int bucket);
+
+    quint64 m_counts[BucketCount];
+    quint64 m_count;
+    quint64 m_sum;
+    qint64 m_min;
+    qint64 m_max;
+};
+
+}
+
+#endif // ZLATENCYHISTOGRAM_H
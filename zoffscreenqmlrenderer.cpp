@@ -0,0 +1,353 @@
+﻿#include "zoffscreenqmlrenderer.h"
+#include "zquickwidget.h"
+#include "zrenderthreadpool.h"
+#include "zcomponentcache.h"
+
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QQmlEngine>
+#include <QQmlComponent>
+#include <QQuickItem>
+#include <QQuickWindow>
+#include <QQuickRenderControl>
+#include <QCoreApplication>
+#include <QDebug>
+
+using namespace ZQuick;
+
+OffscreenQmlRenderer::OffscreenQmlRenderer(QQmlEngine *engine, QObject *parent)
+    : QObject(parent),
+    m_ownsEngine(engine == nullptr),
+    m_initialized(false),
+    m_waitingComponent(nullptr),
+    m_rootItem(nullptr),
+    m_frameNumber(0),
+    m_framePending(false),
+    m_renderScheduled(false)
+{
+    m_context = new QOpenGLContext;
+    m_context->setFormat(QSurfaceFormat::defaultFormat());
+    if (QOpenGLContext *share = QOpenGLContext::globalShareContext())
+        m_context->setShareContext(share);
+    m_context->create();
+
+    m_offscreenSurface = new QOffscreenSurface;
+    m_offscreenSurface->setFormat(m_context->format());
+    m_offscreenSurface->create();
+
+    // 没有对应的窗口，renderWindow()返回空即可
+    m_renderControl = new QQuickRenderControl(this);
+    m_quickWindow = new QQuickWindow(m_renderControl);
+
+    // 缩放比通过缩放contentItem实现，没有窗口就拿不到屏幕的缩放比
+    m_quickWindow->contentItem()->setTransformOrigin(QQuickItem::TopLeft);
+
+    m_qmlEngine = engine ? engine : new QQmlEngine;
+    if (!m_qmlEngine->incubationController())
+        m_qmlEngine->setIncubationController(m_quickWindow->incubationController());
+
+    m_quickRenderer = new QuickRenderer;
+    m_quickRenderer->setContext(m_context);
+    m_quickRenderer->setSurface(m_offscreenSurface);
+    m_quickRenderer->setQuickWindow(m_quickWindow);
+    m_quickRenderer->setRenderControl(m_renderControl);
+    m_quickRenderer->setMailbox(&m_mailbox);
+    // 每个请求都要一张完整的图，即使与上一张相同
+    m_quickRenderer->setDamageTracking(false);
+    // 只在有请求时出图，渲染线程自己推进动画画出来的帧没人要，还会与请求的帧抢渲染线程
+    m_quickRenderer->setRenderThreadAnimations(false);
+
+    connect(m_quickRenderer, &QuickRenderer::frameAvailable,
+            this, &OffscreenQmlRenderer::onFrameAvailable);
+    connect(m_quickRenderer, &QuickRenderer::renderFailed,
+            this, &OffscreenQmlRenderer::onRenderFailed);
+    connect(m_quickRenderer, &QuickRenderer::renderFinished, this, [this] {
+        if (m_quickRenderer->takeFollowUp())
+            renderCurrent();
+    });
+
+    // 异步加载的内容到了之后场景会变化，这时再检查一次是否可以渲染
+    connect(m_renderControl, &QQuickRenderControl::sceneChanged, this, &OffscreenQmlRenderer::onSceneChanged);
+    connect(m_renderControl, &QQuickRenderControl::renderRequested, this, &OffscreenQmlRenderer::onSceneChanged);
+
+    // 等不到的内容不再等，按当时的样子渲染
+    m_loadTimer.setSingleShot(true);
+    m_loadTimer.setInterval(5000);
+    connect(&m_loadTimer, &QTimer::timeout, this, [this] {
+        if (m_rootItem && !m_framePending) {
+            qWarning() << "OffscreenQmlRenderer: still loading after" << m_loadTimer.interval() << "ms, rendering anyway";
+            renderCurrent();
+        }
+    });
+
+    m_quickRendererThread = RenderThreadPool::instance()->acquire();
+    m_renderControl->prepareThread(m_quickRendererThread);
+    m_context->moveToThread(m_quickRendererThread);
+    m_quickRenderer->moveToThread(m_quickRendererThread);
+}
+
+OffscreenQmlRenderer::~OffscreenQmlRenderer()
+{
+    m_loadTimer.stop();
+    while (!m_queue.isEmpty()) {
+        Request request = m_queue.dequeue();
+        request.future.reportCanceled();
+        request.future.reportFinished();
+    }
+
+    m_quickRenderer->mutex()->lock();
+    m_quickRenderer->requestStop();
+    m_quickRenderer->cond()->wait(m_quickRenderer->mutex());
+    m_quickRenderer->mutex()->unlock();
+
+    RenderThreadPool::instance()->release(m_quickRendererThread);
+
+    delete m_rootItem;
+    delete m_renderControl;
+    delete m_quickWindow;
+    if (m_ownsEngine)
+        delete m_qmlEngine;
+
+    delete m_offscreenSurface;
+    delete m_context;
+
+    delete m_quickRenderer;
+}
+
+QFuture<QImage> OffscreenQmlRenderer::render(const QUrl &url, const QSize &size,
+                                             const QVariantMap &properties, qreal dpr)
+{
+    Request request;
+    request.url = url;
+    request.size = size;
+    request.dpr = dpr;
+    request.properties = properties;
+    return enqueue(request);
+}
+
+QFuture<QImage> OffscreenQmlRenderer::renderInto(uchar *buffer, int bytesPerLine,
+                                                 const QUrl &url, const QSize &size,
+                                                 const QVariantMap &properties, qreal dpr)
+{
+    Request request;
+    request.url = url;
+    request.size = size;
+    request.dpr = dpr;
+    request.properties = properties;
+    request.buffer = buffer;
+    request.bytesPerLine = bytesPerLine;
+    return enqueue(request);
+}
+
+QFuture<QImage> OffscreenQmlRenderer::enqueue(Request request)
+{
+    request.future.reportStarted();
+    const QFuture<QImage> future = request.future.future();
+
+    if (request.size.isEmpty() || request.dpr <= 0) {
+        qWarning() << "OffscreenQmlRenderer: invalid size" << request.size << request.dpr;
+        request.future.reportResult(QImage());
+        request.future.reportFinished();
+        return future;
+    }
+
+    // 调用者的缓冲一行放不下一行像素时，finishRequest里会越界写，提前失败
+    if (request.buffer || request.bytesPerLine) {
+        const QSize pixelSize = request.size * request.dpr;
+        if (!request.buffer || request.bytesPerLine < qint64(pixelSize.width()) * 4) {
+            qWarning() << "OffscreenQmlRenderer: buffer too small for" << pixelSize
+                       << "bytesPerLine" << request.bytesPerLine;
+            request.future.reportResult(QImage());
+            request.future.reportFinished();
+            return future;
+        }
+    }
+
+    m_queue.enqueue(request);
+
+    // 调用者先拿到future，实际的polish和sync在下一轮事件循环里做
+    if (m_queue.size() == 1)
+        QMetaObject::invokeMethod(this, &OffscreenQmlRenderer::processNext, Qt::QueuedConnection);
+    return future;
+}
+
+void OffscreenQmlRenderer::processNext()
+{
+    // 上一个请求还在渲染
+    if (m_rootItem || m_queue.isEmpty())
+        return;
+
+    Request &request = m_queue.head();
+    QQmlComponent *component = ComponentCache::forEngine(m_qmlEngine)->component(request.url);
+
+    if (component->isLoading()) {
+        if (m_waitingComponent != component) {
+            if (m_waitingComponent)
+                disconnect(m_waitingComponent, nullptr, this, nullptr);
+            m_waitingComponent = component;
+            connect(component, &QQmlComponent::statusChanged, this, &OffscreenQmlRenderer::processNext);
+        }
+        return;
+    }
+
+    if (m_waitingComponent) {
+        disconnect(m_waitingComponent, nullptr, this, nullptr);
+        m_waitingComponent = nullptr;
+    }
+
+    if (component->isError()) {
+        const QList<QQmlError> errorList = component->errors();
+        for (const QQmlError &error : errorList)
+            qWarning() << error.url() << error.line() << error;
+        failRequest(QStringLiteral("component error"));
+        return;
+    }
+
+    QObject *rootObject = component->createWithInitialProperties(request.properties);
+    m_rootItem = qobject_cast<QQuickItem *>(rootObject);
+    if (!m_rootItem) {
+        delete rootObject;
+        failRequest(QStringLiteral("not a QQuickItem"));
+        return;
+    }
+
+    if (!m_initialized) {
+        m_quickRenderer->requestInit();
+        m_initialized = true;
+    }
+
+    m_rootItem->setParentItem(m_quickWindow->contentItem());
+    m_rootItem->setSize(request.size);
+    m_quickWindow->contentItem()->setScale(request.dpr);
+    m_quickWindow->setGeometry(QRect(QPoint(0, 0), request.size * request.dpr));
+
+    m_framePending = false;
+    m_loadTimer.start();
+    renderCurrent();
+}
+
+bool OffscreenQmlRenderer::isLoading() const
+{
+    // Image、AnimatedImage、BorderImage和Loader都有status和progress属性，Loading的值都是2
+    auto loading = [](const QObject *object) {
+        const QMetaObject *meta = object->metaObject();
+        return meta->indexOfProperty("progress") >= 0 && meta->indexOfProperty("status") >= 0
+                && object->property("status").toInt() == 2;
+    };
+
+    if (loading(m_rootItem))
+        return true;
+    const QList<QQuickItem *> items = m_rootItem->findChildren<QQuickItem *>();
+    for (const QQuickItem *item : items) {
+        if (loading(item))
+            return true;
+    }
+    return false;
+}
+
+void OffscreenQmlRenderer::onSceneChanged()
+{
+    // 帧已经发出的话不再重来，否则持续的动画会让这个请求永远完成不了
+    if (!m_rootItem || m_framePending || m_renderScheduled)
+        return;
+
+    m_renderScheduled = true;
+    QMetaObject::invokeMethod(this, [this] {
+        m_renderScheduled = false;
+        renderCurrent();
+    }, Qt::QueuedConnection);
+}
+
+void OffscreenQmlRenderer::renderCurrent()
+{
+    if (!m_rootItem || m_framePending || m_queue.isEmpty())
+        return;
+
+    // 还有内容在加载，等它们加载完引起的sceneChanged，或者超时
+    if (isLoading() && m_loadTimer.isActive())
+        return;
+
+    // 上一个请求的帧可能还没完全结束（frameAvailable先于finishFrame发出），结束后再来
+    if (!m_quickRenderer->tryBeginFrame(QuickRenderer::SyncPending)) {
+        if (!m_quickRenderer->queueFollowUp(1)) {
+            // 恰好已经结束，自己取回重试
+            m_quickRenderer->takeFollowUp();
+            QMetaObject::invokeMethod(this, &OffscreenQmlRenderer::renderCurrent, Qt::QueuedConnection);
+        }
+        return;
+    }
+
+    m_loadTimer.stop();
+    m_framePending = true;
+
+    const Request &request = m_queue.head();
+    m_renderControl->polishItems();
+
+    // 与ZQuickWidget一样，sync期间ui线程等待，render和读回在渲染线程上进行
+    QMutexLocker lock(m_quickRenderer->mutex());
+    m_frameNumber = m_quickRenderer->nextSequence();
+    m_quickRenderer->setNextFrame(m_frameNumber);
+    m_quickRenderer->setTargetSize(request.size * request.dpr, request.dpr);
+    m_quickRenderer->requestRender();
+    m_quickRenderer->cond()->wait(m_quickRenderer->mutex());
+}
+
+void OffscreenQmlRenderer::onRenderFailed(quint64 frame)
+{
+    if (m_rootItem && m_framePending && frame == m_frameNumber)
+        failRequest(QStringLiteral("render failed"));
+}
+
+void OffscreenQmlRenderer::onFrameAvailable()
+{
+    m_mailbox.clearNotify();
+    if (!m_mailbox.consume())
+        return;
+
+    // 只认当前请求对应的帧
+    const RenderedFrame &frame = m_mailbox.readSlot();
+    if (!m_rootItem || frame.sequence != m_frameNumber)
+        return;
+
+    finishRequest(frame.image);
+}
+
+void OffscreenQmlRenderer::finishRequest(const QImage &image)
+{
+    Request request = m_queue.dequeue();
+    delete m_rootItem;
+    m_rootItem = nullptr;
+    m_framePending = false;
+
+    QImage result = image;
+    if (request.buffer) {
+        const QImage converted = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        result = QImage(request.buffer, converted.width(), converted.height(),
+                        request.bytesPerLine, QImage::Format_ARGB32_Premultiplied);
+        const int rowBytes = qMin(converted.bytesPerLine(), request.bytesPerLine);
+        for (int y = 0; y < converted.height(); ++y)
+            memcpy(result.scanLine(y), converted.constScanLine(y), size_t(rowBytes));
+        result.setDevicePixelRatio(image.devicePixelRatio());
+    }
+
+    request.future.reportResult(result);
+    request.future.reportFinished();
+
+    QMetaObject::invokeMethod(this, &OffscreenQmlRenderer::processNext, Qt::QueuedConnection);
+}
+
+void OffscreenQmlRenderer::failRequest(const QString &reason)
+{
+    Request request = m_queue.dequeue();
+    qWarning() << "OffscreenQmlRenderer:" << request.url << reason;
+
+    delete m_rootItem;
+    m_rootItem = nullptr;
+    m_framePending = false;
+    m_loadTimer.stop();
+
+    request.future.reportResult(QImage());
+    request.future.reportFinished();
+
+    QMetaObject::invokeMethod(this, &OffscreenQmlRenderer::processNext, Qt::QueuedConnection);
+}
@@ -0,0 +1,111 @@
+﻿#ifndef ZOFFSCREENQMLRENDERER_H
+#define ZOFFSCREENQMLRENDERER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QImage>
+#include <QQueue>
+#include <QUrl>
+#include <QVariantMap>
+
+#include "zframemailbox.h"
+
+QT_FORWARD_DECLARE_CLASS(QOpenGLContext)
+QT_FORWARD_DECLARE_CLASS(QOffscreenSurface)
+QT_FORWARD_DECLARE_CLASS(QQuickRenderControl)
+QT_FORWARD_DECLARE_CLASS(QQuickWindow)
+QT_FORWARD_DECLARE_CLASS(QQmlEngine)
+QT_FORWARD_DECLARE_CLASS(QQmlComponent)
+QT_FORWARD_DECLARE_CLASS(QQuickItem)
+QT_FORWARD_DECLARE_CLASS(QThread)
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+class QuickRenderer;
+
+// 不依赖QWidget，把qml渲染成图片
+// 与ZQuickWidget使用同样的渲染线程和QuickRenderer，渲染线程从RenderThreadPool里分配。
+// 请求按顺序逐个处理：每次新建根对象，等异步加载的内容（Loader、async的Image）就绪后
+// polish、sync，渲染和读回在渲染线程上完成，完成后删除根对象。需要并行时创建多个实例即可。
+// 只能在engine所在的线程（通常是ui线程）使用，不需要显示器（可用offscreen平台）
+class OffscreenQmlRenderer : public QObject
+{
+    Q_OBJECT
+
+public:
+    // engine为空时自己创建一个
+    explicit OffscreenQmlRenderer(QQmlEngine *engine = nullptr, QObject *parent = nullptr);
+    ~OffscreenQmlRenderer();
+
+    QQmlEngine *engine() const { return m_qmlEngine; }
+
+    // size是逻辑尺寸，图像的像素尺寸为size * dpr
+    // 组件加载、创建或渲染失败时future的结果为空的QImage
+    QFuture<QImage> render(const QUrl &url, const QSize &size,
+                           const QVariantMap &properties = QVariantMap(), qreal dpr = 1.0);
+
+    // 结果写入调用者提供的缓冲（ARGB32_Premultiplied，至少height * bytesPerLine字节），
+    // 返回的QImage直接引用这块缓冲，future结束之前缓冲必须有效；
+    // bytesPerLine小于width * 4（像素尺寸）时不渲染，future直接以空QImage结束
+    QFuture<QImage> renderInto(uchar *buffer, int bytesPerLine,
+                               const QUrl &url, const QSize &size,
+                               const QVariantMap &properties = QVariantMap(), qreal dpr = 1.0);
+
+    int pendingCount() const { return m_queue.size(); }
+
+    // 最多等待异步内容加载多久，超时后按当时的样子渲染，默认5000ms
+    void setLoadTimeout(int msecs) { m_loadTimer.setInterval(qMax(0, msecs)); }
+    int loadTimeout() const { return m_loadTimer.interval(); }
+
+private slots:
+    void processNext();
+    void onFrameAvailable();
+    void onRenderFailed(quint64 frame);
+    void onSceneChanged();
+
+private:
+    struct Request {
+        QUrl url;
+        QSize size;
+        qreal dpr = 1.0;
+        QVariantMap properties;
+        uchar *buffer = nullptr;
+        int bytesPerLine = 0;
+        QFutureInterface<QImage> future;
+    };
+
+    QFuture<QImage> enqueue(Request request);
+    void finishRequest(const QImage &image);
+    void failRequest(const QString &reason);
+    void renderCurrent();
+    bool isLoading() const;
+
+    QuickRenderer *m_quickRenderer;
+    QThread *m_quickRendererThread;
+    QOpenGLContext *m_context;
+    QOffscreenSurface *m_offscreenSurface;
+    QQuickRenderControl *m_renderControl;
+    QQuickWindow *m_quickWindow;
+    QQmlEngine *m_qmlEngine;
+    bool m_ownsEngine;
+    bool m_initialized;
+
+    ImageMailbox m_mailbox;
+    QQueue<Request> m_queue;
+    QQmlComponent *m_waitingComponent;  // 正在等待加载的组件
+    QQuickItem *m_rootItem;             // 当前请求的根对象
+    quint64 m_frameNumber;
+    bool m_framePending;                // 当前请求的帧已经发出，等待结果
+    bool m_renderScheduled;
+    QTimer m_loadTimer;
+};
+
+}
+
+#endif // ZOFFSCREENQMLRENDERER_H
@@ -0,0 +1,348 @@
+﻿#include "zpixelconvert.h"
+#include "zsimd_p.h"
+
+#include <QCoreApplication>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <QFuture>
+
+#include <cstring>
+
+using namespace ZQuick;
+
+// BT.601全范围，8位定点：系数之和分别为256、0、0。
+// 色度加32768再右移，避免对负数右移；舍入用127而不是128，纯红/纯蓝时刚好是255而不会溢出成0
+static inline uchar lumaOf(int r, int g, int b)
+{
+    return uchar((77 * r + 150 * g + 29 * b + 128) >> 8);
+}
+
+static inline uchar chromaU(int r, int g, int b)
+{
+    return uchar((-43 * r - 85 * g + 128 * b + 127 + 32768) >> 8);
+}
+
+static inline uchar chromaV(int r, int g, int b)
+{
+    return uchar((128 * r - 107 * g - 21 * b + 127 + 32768) >> 8);
+}
+
+// 与_mm_avg_epu8的舍入方式相同，SIMD和普通实现的结果逐字节一致
+static inline int avg(int a, int b)
+{
+    return (a + b + 1) >> 1;
+}
+
+// bgra为true时内存中按B、G、R、A排列（小端的ARGB32），只是R和B的位置对调
+static void lumaRowScalar(const uchar *p, uchar *y, int from, int width, bool bgra)
+{
+    const int r = bgra ? 2 : 0;
+    for (int x = from; x < width; ++x)
+        y[x] = lumaOf(p[x * 4 + r], p[x * 4 + 1], p[x * 4 + 2 - r]);
+}
+
+// 先上下平均，再左右平均
+static void chromaRowScalar(const uchar *p0, const uchar *p1, uchar *u, uchar *v, int from, int width,
+                            bool bgra)
+{
+    const int r = bgra ? 2 : 0;
+    for (int x = from; x < width; x += 2) {
+        const int x1 = x + 1 < width ? x + 1 : x;
+        int c[3];
+        for (int i = 0; i < 3; ++i) {
+            c[i] = avg(avg(p0[x * 4 + i], p1[x * 4 + i]),
+                       avg(p0[x1 * 4 + i], p1[x1 * 4 + i]));
+        }
+        u[x / 2] = chromaU(c[r], c[1], c[2 - r]);
+        v[x / 2] = chromaV(c[r], c[1], c[2 - r]);
+    }
+}
+
+#ifdef ZQUICK_HAVE_SSE2
+// madd之后每个像素是相邻两个32位的和，取出第0、2个
+static inline __m128i sumPairs(__m128i m)
+{
+    return _mm_shuffle_epi32(_mm_add_epi32(m, _mm_srli_epi64(m, 32)), _MM_SHUFFLE(3, 3, 2, 0));
+}
+
+// 通道顺序只影响系数的排列，计算过程完全相同
+static void lumaRowSse2(const uchar *p, uchar *y, int width, bool bgra)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i coeff = bgra ? _mm_setr_epi16(29, 150, 77, 0, 29, 150, 77, 0)
+                               : _mm_setr_epi16(77, 150, 29, 0, 77, 150, 29, 0);
+    const __m128i round = _mm_set1_epi32(128);
+
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + x * 4));
+        const __m128i lo = sumPairs(_mm_madd_epi16(_mm_unpacklo_epi8(px, zero), coeff));
+        const __m128i hi = sumPairs(_mm_madd_epi16(_mm_unpackhi_epi8(px, zero), coeff));
+
+        __m128i sum = _mm_unpacklo_epi64(lo, hi);
+        sum = _mm_srli_epi32(_mm_add_epi32(sum, round), 8);
+        sum = _mm_packs_epi32(sum, sum);
+        sum = _mm_packus_epi16(sum, sum);
+
+        const int packed = _mm_cvtsi128_si32(sum);
+        memcpy(y + x, &packed, 4);
+    }
+    lumaRowScalar(p, y, x, width, bgra);
+}
+
+static void chromaRowSse2(const uchar *p0, const uchar *p1, uchar *u, uchar *v, int width, bool bgra)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i coeffU = bgra ? _mm_setr_epi16(128, -85, -43, 0, 128, -85, -43, 0)
+                                : _mm_setr_epi16(-43, -85, 128, 0, -43, -85, 128, 0);
+    const __m128i coeffV = bgra ? _mm_setr_epi16(-21, -107, 128, 0, -21, -107, 128, 0)
+                                : _mm_setr_epi16(128, -107, -21, 0, 128, -107, -21, 0);
+    const __m128i round = _mm_set1_epi32(127 + 32768);
+
+    // 每次4个像素，得到2个色度样本
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p0 + x * 4));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p1 + x * 4));
+        const __m128i vert = _mm_avg_epu8(a, b);
+        const __m128i both = _mm_avg_epu8(vert, _mm_srli_epi64(vert, 32));
+        const __m128i c = _mm_unpacklo_epi64(_mm_unpacklo_epi8(both, zero),
+                                             _mm_unpackhi_epi8(both, zero));
+
+        __m128i cu = _mm_srli_epi32(_mm_add_epi32(sumPairs(_mm_madd_epi16(c, coeffU)), round), 8);
+        __m128i cv = _mm_srli_epi32(_mm_add_epi32(sumPairs(_mm_madd_epi16(c, coeffV)), round), 8);
+
+        const int pu = _mm_cvtsi128_si32(cu);
+        const int pv = _mm_cvtsi128_si32(cv);
+        u[x / 2] = uchar(pu);
+        v[x / 2] = uchar(pv);
+        u[x / 2 + 1] = uchar(_mm_cvtsi128_si32(_mm_srli_si128(cu, 4)));
+        v[x / 2 + 1] = uchar(_mm_cvtsi128_si32(_mm_srli_si128(cv, 4)));
+    }
+    chromaRowScalar(p0, p1, u, v, x, width, bgra);
+}
+#endif
+
+static void toI420(const uchar *rgba, int bytesPerLine, int width, int height,
+                   uchar *y, int yStride, uchar *u, uchar *v, int uvStride, bool bgra)
+{
+    for (int j = 0; j < height; j += 2) {
+        const uchar *p0 = rgba + j * bytesPerLine;
+        // 高度为奇数时最后一行自己和自己平均
+        const uchar *p1 = j + 1 < height ? p0 + bytesPerLine : p0;
+        uchar *uRow = u + (j / 2) * uvStride;
+        uchar *vRow = v + (j / 2) * uvStride;
+
+#ifdef ZQUICK_HAVE_SSE2
+        lumaRowSse2(p0, y + j * yStride, width, bgra);
+        if (j + 1 < height)
+            lumaRowSse2(p1, y + (j + 1) * yStride, width, bgra);
+        chromaRowSse2(p0, p1, uRow, vRow, width, bgra);
+#else
+        lumaRowScalar(p0, y + j * yStride, 0, width, bgra);
+        if (j + 1 < height)
+            lumaRowScalar(p1, y + (j + 1) * yStride, 0, width, bgra);
+        chromaRowScalar(p0, p1, uRow, vRow, 0, width, bgra);
+#endif
+    }
+}
+
+void PixelConvert::rgbaToI420(const uchar *rgba, int bytesPerLine, int width, int height,
+                              uchar *y, int yStride, uchar *u, uchar *v, int uvStride)
+{
+    toI420(rgba, bytesPerLine, width, height, y, yStride, u, v, uvStride, false);
+}
+
+void PixelConvert::bgraToI420(const uchar *bgra, int bytesPerLine, int width, int height,
+                              uchar *y, int yStride, uchar *u, uchar *v, int uvStride)
+{
+    toI420(bgra, bytesPerLine, width, height, y, yStride, u, v, uvStride, true);
+}
+
+// 每行：RGBA字节 -> 内存中的ARGB32（小端为B、G、R、A），即交换R和B
+// 按32位整数组装，大端机器上也是对的
+static void swizzleRowScalar(const uchar *src, uchar *dst, int from, int width)
+{
+    quint32 *out = reinterpret_cast<quint32 *>(dst);
+    for (int x = from; x < width; ++x) {
+        const uchar *p = src + x * 4;
+        out[x] = (quint32(p[3]) << 24) | (quint32(p[0]) << 16) | (quint32(p[1]) << 8) | p[2];
+    }
+}
+
+#if defined(ZQUICK_HAVE_SSE2) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+static void swizzleRowSse2(const uchar *src, uchar *dst, int width)
+{
+    const __m128i agMask = _mm_set1_epi32(int(0xff00ff00));
+    const __m128i rbMask = _mm_set1_epi32(0x00ff00ff);
+
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 4));
+        const __m128i rb = _mm_and_si128(v, rbMask);
+        const __m128i swapped = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4),
+                         _mm_or_si128(_mm_and_si128(v, agMask), swapped));
+    }
+    swizzleRowScalar(src, dst, x, width);
+}
+#endif
+
+#if defined(ZQUICK_HAVE_AVX2) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+ZQUICK_TARGET_AVX2
+static void swizzleRowAvx2(const uchar *src, uchar *dst, int width)
+{
+    // 每个128位内部按字节重排，R、B互换
+    const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                             2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + x * 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x * 4), _mm256_shuffle_epi8(v, shuffle));
+    }
+    swizzleRowScalar(src, dst, x, width);
+}
+#endif
+
+#ifdef ZQUICK_HAVE_NEON
+static void swizzleRowNeon(const uchar *src, uchar *dst, int width)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t px = vld4q_u8(src + x * 4);
+        const uint8x16_t r = px.val[0];
+        px.val[0] = px.val[2];
+        px.val[2] = r;
+        vst4q_u8(dst + x * 4, px);
+    }
+    swizzleRowScalar(src, dst, x, width);
+}
+#endif
+
+typedef void (*SwizzleRowFn)(const uchar *src, uchar *dst, int width);
+
+struct SwizzleImpl {
+    SwizzleRowFn fn;
+    const char *name;
+};
+
+Q_DECL_UNUSED static void swizzleRowPlain(const uchar *src, uchar *dst, int width)
+{
+    swizzleRowScalar(src, dst, 0, width);
+}
+
+static SwizzleImpl selectSwizzle()
+{
+#if defined(ZQUICK_HAVE_AVX2) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    if (cpuHasAvx2())
+        return {swizzleRowAvx2, "avx2"};
+#endif
+#if defined(ZQUICK_HAVE_SSE2) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    return {swizzleRowSse2, "sse2"};
+#elif defined(ZQUICK_HAVE_NEON)
+    return {swizzleRowNeon, "neon"};
+#else
+    return {swizzleRowPlain, "scalar"};
+#endif
+}
+
+static const SwizzleImpl &swizzleImpl()
+{
+    static const SwizzleImpl impl = selectSwizzle();
+    return impl;
+}
+
+// 超过这个像素数才分条带并行，小图线程切换的开销比转换本身还大
+static const int PARALLEL_PIXELS = 1 << 20;
+// 每个条带至少这么多行
+static const int MIN_BAND_ROWS = 64;
+
+// 单独的小线程池，不占用QThreadPool::globalInstance()，也不会被别的任务堵住
+static QThreadPool *convertPool()
+{
+    static QThreadPool *pool = [] {
+        QThreadPool *p = new QThreadPool(QCoreApplication::instance());
+        p->setMaxThreadCount(qBound(1, QThread::idealThreadCount() - 1, 4));
+        p->setExpiryTimeout(5000);
+        return p;
+    }();
+    return pool;
+}
+
+static void flipBand(const uchar *src, int srcBytesPerLine, int width, int height,
+                     uchar *dst, int dstBytesPerLine, int firstRow, int lastRow)
+{
+    const SwizzleRowFn swizzleRow = swizzleImpl().fn;
+    for (int y = firstRow; y < lastRow; ++y)
+        swizzleRow(src + (height - 1 - y) * srcBytesPerLine, dst + y * dstBytesPerLine, width);
+}
+
+void PixelConvert::flipRgbaToArgb32(const uchar *src, int srcBytesPerLine, int width, int height,
+                                    uchar *dst, int dstBytesPerLine)
+{
+    QThreadPool *pool = QCoreApplication::instance() && width * height >= PARALLEL_PIXELS
+            ? convertPool() : nullptr;
+    const int bands = pool ? qMin(pool->maxThreadCount() + 1, height / MIN_BAND_ROWS) : 1;
+
+    if (bands <= 1) {
+        flipBand(src, srcBytesPerLine, width, height, dst, dstBytesPerLine, 0, height);
+        return;
+    }
+
+    // 第一个条带在当前线程上做，其余的交给线程池
+    const int rowsPerBand = (height + bands - 1) / bands;
+    QVector<QFuture<void>> futures;
+    futures.reserve(bands - 1);
+    for (int i = 1; i < bands; ++i) {
+        const int first = i * rowsPerBand;
+        const int last = qMin(height, first + rowsPerBand);
+        if (first >= last)
+            break;
+        futures.append(QtConcurrent::run(pool, [=] {
+            flipBand(src, srcBytesPerLine, width, height, dst, dstBytesPerLine, first, last);
+        }));
+    }
+
+    flipBand(src, srcBytesPerLine, width, height, dst, dstBytesPerLine, 0, qMin(height, rowsPerBand));
+
+    for (QFuture<void> &f : futures)
+        f.waitForFinished();
+}
+
+void PixelConvert::prepareArgb32Image(QImage *image, int width, int height)
+{
+    // 信箱里的图像平时不会被共享，可以直接复用；被FrameSink之类持有时重新分配，省掉分离时的拷贝。
+    // 引用外部缓冲、行距不紧凑的（例如图集的切片）也重新分配：调用者可能按紧凑的行直接写入
+    if (image->size() != QSize(width, height)
+            || image->format() != QImage::Format_ARGB32_Premultiplied
+            || image->bytesPerLine() != width * 4
+            || !image->isDetached())
+        *image = QImage(width, height, QImage::Format_ARGB32_Premultiplied);
+}
+
+void PixelConvert::flipRgbaToImage(const uchar *src, int width, int height, QImage *image)
+{
+    prepareArgb32Image(image, width, height);
+    flipRgbaToArgb32(src, width * 4, width, height, image->bits(), image->bytesPerLine());
+}
+
+void PixelConvert::copyArgb32ToImage(const uchar *src, int width, int height, QImage *image)
+{
+    prepareArgb32Image(image, width, height);
+
+    // ARGB32每行本来就是4字节对齐的，通常可以一次拷完
+    const int rowBytes = width * 4;
+    if (image->bytesPerLine() == rowBytes) {
+        memcpy(image->bits(), src, size_t(rowBytes) * size_t(height));
+        return;
+    }
+    for (int y = 0; y < height; ++y)
+        memcpy(image->scanLine(y), src + y * rowBytes, size_t(rowBytes));
+}
+
+// rgbaToI420只有SSE2和普通实现，这里给出的是翻转换通道用的实现
+const char *PixelConvert::implementation()
+{
+    return swizzleImpl().name;
+}
@@ -0,0 +1,47 @@
+﻿#ifndef ZPIXELCONVERT_H
+#define ZPIXELCONVERT_H
+
+#include <QImage>
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+// 像素格式转换，按CPU支持的指令集选择实现
+namespace PixelConvert {
+
+// 内存中按R、G、B、A排列的32位像素转为I420（BT.601全范围，与Y4M的C420jpeg对应）
+// 色度取2x2块的平均，宽高为奇数时最后一行/列单独处理；alpha被忽略
+void rgbaToI420(const uchar *rgba, int bytesPerLine, int width, int height,
+                uchar *y, int yStride, uchar *u, uchar *v, int uvStride);
+
+// 同上，内存中按B、G、R、A排列（小端机器上的ARGB32），读回的图像不用先转成RGBA
+void bgraToI420(const uchar *bgra, int bytesPerLine, int width, int height,
+                uchar *y, int yStride, uchar *u, uchar *v, int uvStride);
+
+// glReadPixels读出的自下而上的RGBA（预乘）转为自上而下的ARGB32_Premultiplied，
+// 翻转和换通道一次完成；大图分成若干条带，在单独的小线程池上并行转换
+void flipRgbaToArgb32(const uchar *src, int srcBytesPerLine, int width, int height,
+                      uchar *dst, int dstBytesPerLine);
+
+// 同上，结果写入image（经过prepareArgb32Image）
+void flipRgbaToImage(const uchar *src, int width, int height, QImage *image);
+
+// 已经是自上而下ARGB32排列的紧密数据（例如GpuConvertPass的结果），直接拷贝进image
+void copyArgb32ToImage(const uchar *src, int width, int height, QImage *image);
+
+// 保证image是可以直接写入的、行距紧凑的ARGB32_Premultiplied：
+// 尺寸、格式和行距相同且没有被共享时复用它的内存，否则重新分配（不会先拷贝一遍旧内容）。
+// 只读的外部缓冲无法判断，bits()会悄悄拷贝一份，不要把只读的QImage交给它
+void prepareArgb32Image(QImage *image, int width, int height);
+
+// 当前使用的实现："avx2"、"sse2"、"neon"或"scalar"
+const char *implementation();
+
+}
+
+}
+
+#endif // ZPIXELCONVERT_H
@@ -1,7 +1,13 @@
 ﻿#include "zquickwidget.h"
+#include "zrenderthreadpool.h"
+#include "zcomponentcache.h"
+#include "zpixelconvert.h"
+#include "zatlascompositor.h"
+#include "zrenderanimationdriver.h"
 
 #include <QOpenGLContext>
 #include <QOpenGLFunctions>
+#include <QOpenGLExtraFunctions>
 #include <QOpenGLFramebufferObject>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLVertexArrayObject>
@@ -14,21 +20,49 @@
 #include <QQuickWindow>
 #include <QQuickRenderControl>
 #include <QCoreApplication>
+#include <QPointer>
 
 #include <QTimer>
 #include <QDateTime>
 #include <QElapsedTimer>
 #include <QPainter>
+#include <QPaintEvent>
+
+#include <algorithm>
 
 using namespace ZQuick;
 
 static const QEvent::Type INIT   = QEvent::Type(QEvent::User + 1);
 static const QEvent::Type RENDER = QEvent::Type(QEvent::User + 2);
-static const QEvent::Type RESIZE = QEvent::Type(QEvent::User + 3);
 static const QEvent::Type STOP   = QEvent::Type(QEvent::User + 4);
 
 static const QEvent::Type UPDATE = QEvent::Type(QEvent::User + 5);
 
+// 只需要render，不需要polish和sync（对应renderRequested）
+static const QEvent::Type RENDER_ONLY = QEvent::Type(QEvent::User + 6);
+
+// sync之后的render阶段单独作为一个事件排队。
+// 渲染线程被多个渲染器共用时，其他渲染器的sync可以插在前面，
+// ui线程等待sync的时间不会被别的窗口的render拖长
+static const QEvent::Type RENDER_PHASE = QEvent::Type(QEvent::User + 7);
+
+// fbo按这个粒度向上取整分配，拖动改变尺寸时大部分情况下不用重新分配
+static const int FBO_BUCKET = 128;
+
+static QSize bucketSize(const QSize &size)
+{
+    return QSize((size.width() + FBO_BUCKET - 1) / FBO_BUCKET * FBO_BUCKET,
+                 (size.height() + FBO_BUCKET - 1) / FBO_BUCKET * FBO_BUCKET);
+}
+
+// 能装下、且最多比需要的大一档，缩小时不会马上重新分配
+static bool fboFits(const QSize &fboSize, const QSize &size)
+{
+    const QSize limit = bucketSize(size) + QSize(FBO_BUCKET, FBO_BUCKET);
+    return fboSize.width() >= size.width() && fboSize.height() >= size.height()
+            && fboSize.width() <= limit.width() && fboSize.height() <= limit.height();
+}
+
 QuickRenderer::QuickRenderer()
     :
     m_context(nullptr),
@@ -37,8 +71,31 @@ QuickRenderer::QuickRenderer()
     m_quickWindow(nullptr),
     m_renderControl(nullptr),
     m_quit(false),
-    m_widget(nullptr)
+    m_mailbox(nullptr),
+    m_textureMailbox(nullptr),
+    m_atlas(nullptr),
+    m_renderThreadAnimations(true),
+    m_animationDriver(nullptr),
+    m_timings(nullptr),
+    m_sequence(0),
+    m_nextFrame(0),
+    m_renderOnlyFrame(0),
+    m_currentFrame(0),
+    m_nextDpr(1.0),
+    m_dpr(1.0),
+    m_readbackMode(PboReadback),
+    m_gpuConvert(0),
+    m_drainRetries(0),
+    m_damageTracking(true),
+    m_frameState(Idle),
+    m_frameStartNs(0)
 {
+    // 没有新帧时，用它把PBO里还没取走的最后一帧取出来
+    // 作为子对象，会随本对象一起被移到渲染线程
+    m_drainTimer = new QTimer(this);
+    m_drainTimer->setSingleShot(true);
+    m_drainTimer->setInterval(1);
+    connect(m_drainTimer, &QTimer::timeout, this, &QuickRenderer::drainReadback);
 }
 
 void QuickRenderer::requestInit()
@@ -48,13 +105,58 @@ void QuickRenderer::requestInit()
 
 void QuickRenderer::requestRender()
 {
-    mHasPostRender = true;
+    Q_ASSERT(m_frameState.loadAcquire() == SyncPending);
     QCoreApplication::postEvent(this, new QEvent(RENDER));
 }
 
-void QuickRenderer::requestResize()
+void QuickRenderer::requestRenderOnly(quint64 frame)
+{
+    Q_ASSERT(m_frameState.loadAcquire() == Rendering);
+    m_renderOnlyFrame = frame;
+    QCoreApplication::postEvent(this, new QEvent(RENDER_ONLY));
+}
+
+bool QuickRenderer::queueFollowUp(int kind, bool *merged)
+{
+    // 之前的值不为0，说明已经有一帧在排队，这次被合并了
+    const int old = m_followUp.fetchAndOrOrdered(kind);
+    if (merged)
+        *merged = old != 0;
+
+    // 渲染线程可能在我们登记之前就已经结束并检查过m_followUp了，
+    // 这种情况下由调用者自己通过takeFollowUp()取回
+    return m_frameState.loadAcquire() != Idle;
+}
+
+int QuickRenderer::takeFollowUp()
+{
+    return m_followUp.fetchAndStoreOrdered(0);
+}
+
+void QuickRenderer::finishFrame()
+{
+    m_lastFrameCost.storeRelease(FrameTimings::now() - m_frameStartNs);
+    // 必须是读-改-写：与queueFollowUp()里先登记后检查状态的顺序相对，
+    // 单纯的release写之后再acquire读不保证先后（StoreLoad），两边可能都以为对方会处理这一帧
+    m_frameState.fetchAndStoreOrdered(Idle);
+
+    // 只有ui线程登记了后续帧时才通知，平时不产生多余的事件
+    if (m_followUp.loadAcquire())
+        emit renderFinished();
+}
+
+void QuickRenderer::addFrameSink(FrameSink *sink)
+{
+    QMutexLocker lock(&m_sinkMutex);
+    if (!m_sinks.contains(sink))
+        m_sinks.append(sink);
+}
+
+void QuickRenderer::removeFrameSink(FrameSink *sink)
 {
-    QCoreApplication::postEvent(this, new QEvent(RESIZE));
+    // 返回之后渲染线程不会再调用这个sink
+    QMutexLocker lock(&m_sinkMutex);
+    m_sinks.removeAll(sink);
 }
 
 void QuickRenderer::requestStop()
@@ -73,11 +175,20 @@ bool QuickRenderer::event(QEvent *e)
     case RENDER:{
         // 之所以主线程需要等那么久，是因为本线程还在处理，
         // 无法进入事件处理，因此一直在等待
-        render(&lock);
-        mHasPostRender = false;
+        if (!render(&lock))
+            finishFrame();
     }
         return true;
-    case RESIZE:
+    case RENDER_PHASE:
+        lock.unlock();
+        renderPhase();
+        finishFrame();
+        return true;
+    case RENDER_ONLY:
+        // 不涉及sync，ui线程不需要等待
+        lock.unlock();
+        renderOnly(m_renderOnlyFrame);
+        finishFrame();
         return true;
     case STOP:
         cleanup();
@@ -97,6 +208,16 @@ void QuickRenderer::init()
     // be backed by an actual QWindow).
 
     m_renderControl->initialize(m_context);
+
+    m_readback.initialize(m_context);
+    m_convertPass.initialize(m_context);
+
+    // 渲染线程上发出的renderRequested来自Animator，交给驱动在渲染线程上处理
+    if (m_renderThreadAnimations) {
+        m_animationDriver = RenderAnimationDriver::attach(this);
+        connect(m_renderControl, &QQuickRenderControl::renderRequested,
+                this, &QuickRenderer::onRenderRequested, Qt::DirectConnection);
+    }
 }
 
 void QuickRenderer::cleanup()
@@ -105,84 +226,348 @@ void QuickRenderer::cleanup()
 
     m_renderControl->invalidate();
 
+    if (m_animationDriver) {
+        disconnect(m_renderControl, &QQuickRenderControl::renderRequested,
+                   this, &QuickRenderer::onRenderRequested);
+        m_animationDriver->detach(this);
+        m_animationDriver = nullptr;
+    }
+
+    m_drainTimer->stop();
+    m_readback.cleanup();
+    m_convertPass.cleanup();
+
     delete m_fbo;
     m_fbo = nullptr;
 
+    if (m_textureMailbox) {
+        for (int i = 0; i < TextureMailbox::slotCount(); ++i) {
+            TextureFrame &frame = m_textureMailbox->slotAt(i);
+            if (frame.fence)
+                m_context->extraFunctions()->glDeleteSync(frame.fence);
+            frame.fence = nullptr;
+            delete frame.fbo;
+            frame.fbo = nullptr;
+        }
+    }
+
+    if (m_atlas)
+        m_atlas->remove(this);
+
     m_context->doneCurrent();
     m_context->moveToThread(QCoreApplication::instance()->thread());
 
+    // 渲染线程可能是共用的，停止后不会退出，
+    // 把自己也移回ui线程，之后才能在ui线程里安全地delete
+    moveToThread(QCoreApplication::instance()->thread());
+
     m_cond.wakeOne();
 }
 
-void QuickRenderer::ensureFbo()
+bool QuickRenderer::ensureFbo()
 {
-    if (m_fbo && m_fbo->size() != m_widget->size() * m_widget->devicePixelRatio()) {
-        delete m_fbo;
-        m_fbo = nullptr;
+    // GPU直接显示时，每帧渲染到信箱当前可写的那个fbo，三个fbo轮换
+    QOpenGLFramebufferObject *&fbo = m_textureMailbox ? m_textureMailbox->writeSlot().fbo : m_fbo;
+    const QSize size = m_targetSize.expandedTo(QSize(1, 1));
+
+    if (fbo && !fboFits(fbo->size(), size)) {
+        delete fbo;
+        fbo = nullptr;
     }
 
-    if (!m_fbo) {
-        m_fbo = new QOpenGLFramebufferObject(m_widget->size() * m_widget->devicePixelRatio(),
-                                             QOpenGLFramebufferObject::CombinedDepthStencil);
-        m_quickWindow->setRenderTarget(m_fbo);
+    if (!fbo) {
+        fbo = new QOpenGLFramebufferObject(bucketSize(size),
+                                           QOpenGLFramebufferObject::CombinedDepthStencil);
+        if (!fbo->isValid()) {
+            qWarning() << "QuickRenderer: cannot create framebuffer object" << bucketSize(size);
+            delete fbo;
+            fbo = nullptr;
+            return false;
+        }
     }
+
+    // 场景只画在fbo左下角size大小的区域，读取时也只读这一块。
+    // 以前比较fbo指针，删掉重建的fbo可能恰好分配在同一地址，
+    // 窗口就会继续往已删除的fbo里画，这就是改变尺寸后渲染失效的原因
+    m_quickWindow->setRenderTarget(fbo->handle(), size);
+    return true;
 }
 
-void QuickRenderer::render(QMutexLocker *lock)
+bool QuickRenderer::render(QMutexLocker *lock)
 {
-    static int counter = 0;
-    counter++;
+    // ui线程此时在等待，可以直接读取它设置的帧号和尺寸
+    m_currentFrame = m_nextFrame;
+    m_targetSize = m_nextSize;
+    m_dpr = m_nextDpr;
+    m_frameStartNs = FrameTimings::now();
 
-    mProcessState = 1;
-    mFinished = false;
-
-    QElapsedTimer timer;
-    timer.start();
+    m_frameState.storeRelease(Syncing);
 
+    // 不唤醒的话ui线程会一直等下去
     if (!m_context->makeCurrent(m_surface)) {
         qWarning("Failed to make context current on render thread");
-        mFinished = true;
-        return;
+        m_cond.wakeOne();
+        emit renderFailed(m_currentFrame);
+        return false;
     }
 
-    ensureFbo();
+    if (!ensureFbo()) {
+        m_cond.wakeOne();
+        emit renderFailed(m_currentFrame);
+        return false;
+    }
 
     // Synchronization and rendering happens here on the render thread.
-    m_renderControl->sync();
+    {
+        FrameTimings::Scope scope(m_timings, FrameTimings::Sync, m_currentFrame);
+        m_renderControl->sync();
+    }
 
     // ui线程目前可以继续操作了
     // The gui thread can now continue.
     m_cond.wakeOne();
     lock->unlock();
 
-    mProcessState = 2;
-    mFinished = true;
+    // 从这里开始ui线程可以polish下一帧了
+    m_frameState.storeRelease(Rendering);
+
+    // 实际的渲染排到队尾，先让同一线程上其他渲染器的sync完成
+    QCoreApplication::postEvent(this, new QEvent(RENDER_PHASE));
+    return true;
+}
 
-    qDebug() << "渲染同步到ui耗时：" << timer.elapsed() << counter;
+void QuickRenderer::renderPhase()
+{
+    // 若STOP插在了sync和这里之间，cleanup()会把本对象移回ui线程，
+    // 本事件随之转移，并在ui线程delete本对象时被丢弃，不会执行到这里
+    if (!m_context->makeCurrent(m_surface)) {
+        qWarning("Failed to make context current on render thread");
+        emit renderFailed(m_currentFrame);
+        return;
+    }
 
     // Meanwhile on this thread continue with the actual rendering (into the FBO first).
-    m_renderControl->render();
-    m_context->functions()->glFlush();
+    {
+        FrameTimings::Scope scope(m_timings, FrameTimings::Render, m_currentFrame);
+        m_renderControl->render();
+        m_context->functions()->glFlush();
+    }
+
+    present();
+}
+
+void QuickRenderer::renderOnly(quint64 frame)
+{
+    m_frameStartNs = FrameTimings::now();
+    // 只render的帧也有自己的序号，否则会被当成上一次sync的帧，输入延迟少算
+    m_currentFrame = frame;
+
+    if (!m_context->makeCurrent(m_surface)) {
+        qWarning("Failed to make context current on render thread");
+        emit renderFailed(m_currentFrame);
+        return;
+    }
+
+    // 场景树没有变化，只是需要重新画一遍（例如Scene3D、ShaderEffect的刷新）
+    if (!ensureFbo()) {
+        emit renderFailed(m_currentFrame);
+        return;
+    }
+    {
+        FrameTimings::Scope scope(m_timings, FrameTimings::Render, m_currentFrame);
+        m_renderControl->render();
+        m_context->functions()->glFlush();
+    }
+
+    present();
+}
+
+void QuickRenderer::onRenderRequested()
+{
+    // ui线程上发出的由ZQuickWidget处理
+    if (QThread::currentThread() == thread() && m_animationDriver)
+        m_animationDriver->requestFrame(this);
+}
 
-    mProcessState = 3;
+void QuickRenderer::renderAnimationFrame()
+{
+    // ui线程已经发起了一帧、或者还在进行，那一帧的render同样会推进Animator，这里不用再画
+    if (!m_frameState.testAndSetOrdered(Idle, Rendering))
+        return;
 
+    renderOnly(nextSequence());
+    finishFrame();
+}
 
-    // 又刷新，又改变窗口大小时，有时会在这里卡死
-    // 是grab这个函数卡死
-    qDebug() << "获取图像：" << timer.elapsed() << counter;
-    // 这里是否需要copy还得测试测试。下面两种方式效率差不多
-    // QImage image = m_renderControl->grab().copy();
-    QImage image = m_quickWindow->grabWindow().copy();
-    // QImage image = m_fbo->toImage();
-    qDebug() << "开始发送图像：" << timer.elapsed() << counter;
-    emit rendered(image);
+void QuickRenderer::present()
+{
+    FrameTimings::Scope scope(m_timings, FrameTimings::Readback, m_currentFrame);
 
-    // 假如搞成QOpenGLWidget来渲染，性能可能会好一些
-    // 大概测试了一下， 耗时大约是从 45ms-》38ms 左右；感觉提升不大
-    qDebug() << "子线程渲染耗时：" << timer.elapsed() << mProcessState << counter;
+    if (m_textureMailbox)
+        publishTexture();
+    else if (!m_atlas || !blitToAtlas())
+        readback();
+}
 
-    // m_context->swapBuffers();
+bool QuickRenderer::blitToAtlas()
+{
+    // 合成器在自己的上下文里读这一帧的纹理，要先确保这边画完；与publishTexture()相同
+    QOpenGLExtraFunctions *f = m_context->extraFunctions();
+    GLsync fence = nullptr;
+    if (m_readback.isSupported()) {
+        fence = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        f->glFlush();
+    } else {
+        f->glFinish();
+    }
 
+    // 图集放不下时自己读回，下一帧再试
+    const bool queued = m_atlas->submit(this, m_fbo->texture(), m_quickWindow->renderTargetSize(),
+                                        m_currentFrame, fence);
+    if (!queued) {
+        // 合成器可能已经切换了当前上下文
+        m_context->makeCurrent(m_surface);
+        if (fence)
+            f->glDeleteSync(fence);
+    }
+    return queued;
+}
+
+void QuickRenderer::publishSlice(const QImage &image, quint64 sequence)
+{
+    // 切片与图集共享内存；之后自己读回写这个槽时，行距与图集不同的由prepareArgb32Image重新分配
+    m_mailbox->writeSlot().image = image;
+    publishFrame(sequence);
+}
+
+void QuickRenderer::readback()
+{
+    const QSize size = m_quickWindow->renderTargetSize();
+
+    // 先在GPU上画成读出来就能直接用的样子
+    QOpenGLFramebufferObject *source = m_fbo;
+    QOpenGLFramebufferObject *converted = gpuConvert() ? m_convertPass.convert(m_fbo, size) : nullptr;
+    if (converted)
+        source = converted;
+
+    if (readbackMode() == PboReadback && m_readback.isSupported()) {
+        // 先发起本帧的读取，再取之前已经完成的帧，
+        // 第N帧要等第N+1帧发出去之后才map，渲染线程不用等GPU
+        m_readback.queue(source, size, m_currentFrame, converted != nullptr);
+
+        quint64 frame = 0;
+        if (m_readback.takeLatest(&m_mailbox->writeSlot().image, false, &frame))
+            publishFrame(frame);
+
+        m_drainRetries = 0;
+        if (m_readback.hasPending())
+            m_drainTimer->start();
+    } else {
+        // 以前用grabWindow()：它会把场景再render一遍，读出来之后Qt再翻转、转换格式，
+        // 之后还要copy一次。现在直接从fbo读出有效区域，翻转和换通道一次完成，
+        // 结果直接写进信箱的槽里
+        QOpenGLFunctions *f = m_context->functions();
+        QImage &image = m_mailbox->writeSlot().image;
+        source->bind();
+        f->glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+        if (converted) {
+            // 已经是ARGB32的排列，直接读进图像
+            PixelConvert::prepareArgb32Image(&image, size.width(), size.height());
+            f->glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE, image.bits());
+        } else {
+            m_readPixels.resize(size.width() * size.height() * 4);
+            f->glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE, m_readPixels.data());
+            PixelConvert::flipRgbaToImage(reinterpret_cast<const uchar *>(m_readPixels.constData()),
+                                          size.width(), size.height(), &image);
+        }
+        publishFrame(m_currentFrame);
+    }
+
+    // 自己改过GL状态，还给Qt Quick之前恢复
+    if (converted)
+        m_quickWindow->resetOpenGLState();
+}
+
+void QuickRenderer::publishFrame(quint64 sequence)
+{
+    RenderedFrame &frame = m_mailbox->writeSlot();
+
+    // 与上一帧比较，画面没变就不投递，ui线程也不用重绘
+    QRegion damage = m_damageTracking ? m_diff.update(frame.image) : QRegion(frame.image.rect());
+    if (damage.isEmpty()) {
+        m_mailbox->markUnchanged();
+        return;
+    }
+
+    // 上一帧还没被取走的话会被这一帧覆盖，它的变化区域也要带上
+    if (m_mailbox->hasUnconsumed())
+        damage |= m_lastDamage;
+    m_lastDamage = damage;
+
+    frame.image.setDevicePixelRatio(m_dpr);
+    frame.damage = damage;
+    frame.sequence = sequence;
+    frame.publishedNs = FrameTimings::now();
+
+    // publish之后这个槽就归ui线程了，先留一份隐式共享的副本
+    const QImage image = frame.image;
+    const qint64 publishedNs = frame.publishedNs;
+    m_mailbox->publish();
+
+    {
+        QMutexLocker lock(&m_sinkMutex);
+        for (FrameSink *sink : qAsConst(m_sinks))
+            sink->frameReady(image, sequence, publishedNs);
+    }
+
+    // ui线程还没处理上一个通知的话，它自然会取到最新的这一帧
+    if (m_mailbox->requestNotify())
+        emit frameAvailable();
+}
+
+void QuickRenderer::publishTexture()
+{
+    QOpenGLExtraFunctions *f = m_context->extraFunctions();
+    TextureFrame &frame = m_textureMailbox->writeSlot();
+
+    // 被覆盖掉、没有人等待过的fence
+    if (frame.fence)
+        f->glDeleteSync(frame.fence);
+
+    // 支持fence时由ui线程的上下文在GPU上等待，否则只能在这里等GPU画完
+    if (m_readback.isSupported()) {
+        frame.fence = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        f->glFlush();
+    } else {
+        frame.fence = nullptr;
+        f->glFinish();
+    }
+
+    frame.size = m_quickWindow->renderTargetSize();
+    frame.sequence = m_currentFrame;
+    frame.publishedNs = FrameTimings::now();
+    m_textureMailbox->publish();
+
+    if (m_textureMailbox->requestNotify())
+        emit frameAvailable();
+}
+
+void QuickRenderer::drainReadback()
+{
+    // 之后没有新的帧来把最后一帧带出来，这里单独取一次
+    if (!m_readback.hasPending() || !m_context->makeCurrent(m_surface))
+        return;
+
+    // 多试几次还没完成，就只能阻塞等一下了
+    const bool wait = ++m_drainRetries > 3;
+
+    quint64 frame = 0;
+    if (m_readback.takeLatest(&m_mailbox->writeSlot().image, wait, &frame))
+        publishFrame(frame);
+
+    if (m_readback.hasPending())
+        m_drainTimer->start();
 }
 
 void QuickRenderer::aboutToQuit()
@@ -220,13 +605,108 @@ private:
 
 
 ZQuickWidget::ZQuickWidget(QWidget *parent)
+    :
+    ZQuickWidget(nullptr, parent)
+{
+}
+
+ZQuickWidget::ZQuickWidget(QQmlEngine *engine, QWidget *parent)
     :
     QWidget(parent),
+    m_quickRendererThread(nullptr),
+    m_context(nullptr),
+    m_offscreenSurface(nullptr),
+    m_renderControl(nullptr),
+    m_quickWindow(nullptr),
+    m_qmlEngine(engine),
     m_qmlComponent(nullptr),
     m_rootItem(nullptr),
     m_quickInitialized(false),
-    m_psrRequested(false)
+    m_pendingUpdate(0),
+    m_resizePending(false),
+    m_presenter(nullptr),
+    m_presentMode(CpuPresent),
+    m_atlas(nullptr),
+    m_ownsEngine(engine == nullptr),
+    m_incubator(nullptr),
+    m_status(Null),
+    m_asynchronousLoading(true),
+    m_engineReady(false),
+    m_hasThreadScheduling(false),
+    m_createPending(false),
+    m_constructedNs(FrameTimings::now()),
+    m_compileStartNs(0),
+    m_createStartNs(0),
+    m_readyNs(0)
 {
+    // 键盘需要焦点，悬停需要不按键时的鼠标移动
+    setFocusPolicy(Qt::StrongFocus);
+    setMouseTracking(true);
+    setAttribute(Qt::WA_AcceptTouchEvents);
+
+    m_governor = new FrameRateGovernor(this);
+
+    m_frameTimer = new QTimer(this);
+    m_frameTimer->setSingleShot(true);
+    m_frameTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_frameTimer, &QTimer::timeout, this, [=](){
+        QCoreApplication::postEvent(this, new QEvent(UPDATE));
+    });
+
+    // 渲染器本身只是一个普通的QObject，先创建出来，读回方式、帧接收者等设置可以在加载前进行；
+    // GL上下文、窗口和渲染线程等到第一次显示并且有source时再创建，见ensureScene()
+    m_quickRenderer = new QuickRenderer;
+    m_quickRenderer->setMailbox(&m_mailbox);
+    m_quickRenderer->setFrameTimings(&m_timings);
+
+    // 帧本身放在信箱里，这里只是一个“有新帧”的通知
+    connect(m_quickRenderer, &QuickRenderer::frameAvailable, this, [=](){
+        if (m_presenter) {
+            m_textureMailbox.clearNotify();
+            m_presenter->update();
+        } else {
+            m_mailbox.clearNotify();
+            takeFrame();
+        }
+    });
+    connect(m_quickRenderer, &QuickRenderer::renderFinished, this, &ZQuickWidget::onRenderFinished);
+}
+
+QQmlEngine *ZQuickWidget::ensureEngine()
+{
+    if (m_engineReady)
+        return m_qmlEngine;
+    m_engineReady = true;
+
+    // Create a QML engine.
+    // 也可以传入一个共用的engine，同一ui线程上的控件共用导入、插件和类型缓存
+    if (!m_qmlEngine) {
+        const qint64 start = FrameTimings::now();
+        m_qmlEngine = new QQmlEngine;
+        m_startup.engine = (FrameTimings::now() - start) / 1e6;
+    }
+
+    // 离屏窗口没有渲染循环，它自带的控制器驱动不了异步创建，换成定时器驱动的
+    IncubationController *incubation = IncubationController::forEngine(m_qmlEngine);
+    if (incubation) {
+        connect(incubation, &IncubationController::incubated, this, [this](int remaining) {
+            if (m_status == Loading)
+                emit loadingProgress(remaining);
+        });
+    }
+    return m_qmlEngine;
+}
+
+QQmlEngine *ZQuickWidget::engine() const
+{
+    return const_cast<ZQuickWidget *>(this)->ensureEngine();
+}
+
+void ZQuickWidget::ensureScene()
+{
+    if (m_quickWindow)
+        return;
+
     // setSurfaceType(QSurface::OpenGLSurface);
 
     // QSurfaceFormat format;
@@ -235,8 +715,13 @@ ZQuickWidget::ZQuickWidget(QWidget *parent)
     // format.setStencilBufferSize(8);
     // setFormat(format);
 
+    const qint64 contextStart = FrameTimings::now();
     m_context = new QOpenGLContext;
     m_context->setFormat(QSurfaceFormat::defaultFormat());
+    // 加入全局共享组，GpuPresent模式下ui线程才能直接采样渲染线程的纹理，
+    // 使用合成器时合成器才能读到这里的纹理
+    if (QOpenGLContext *share = QOpenGLContext::globalShareContext())
+        m_context->setShareContext(share);
     m_context->create();
 
     m_offscreenSurface = new QOffscreenSurface;
@@ -247,6 +732,9 @@ ZQuickWidget::ZQuickWidget(QWidget *parent)
     m_offscreenSurface->setFormat(m_context->format());
     m_offscreenSurface->create();
 
+    const qint64 sceneStart = FrameTimings::now();
+    m_startup.context = (sceneStart - contextStart) / 1e6;
+
     m_renderControl = new RenderControl(this);
 
     // Create a QQuickWindow that is associated with out render control. Note that this
@@ -257,26 +745,18 @@ ZQuickWidget::ZQuickWidget(QWidget *parent)
     // 将窗口给回去，renderWindow这个函数会用到
     ((RenderControl*)m_renderControl)->setWindow(m_quickWindow);
 
-    // Create a QML engine.
-    m_qmlEngine = new QQmlEngine;
-    if (!m_qmlEngine->incubationController())
-        m_qmlEngine->setIncubationController(m_quickWindow->incubationController());
-
-    m_quickRenderer = new QuickRenderer;
     m_quickRenderer->setContext(m_context);
 
-    connect(m_quickRenderer, &QuickRenderer::rendered, this, [=](QImage img){
-        mImg = img;
-        update();
-    });
-
     // These live on the gui thread. Just give access to them on the render thread.
     m_quickRenderer->setSurface(m_offscreenSurface);
-    m_quickRenderer->setWidget(this);
     m_quickRenderer->setQuickWindow(m_quickWindow);
     m_quickRenderer->setRenderControl(m_renderControl);
 
-    m_quickRendererThread = new QThread;
+    // 从线程池里分配，线程数达到上限后多个控件共用一个渲染线程；使用合成器时用合成器的线程
+    m_quickRendererThread = m_atlas ? m_atlas->thread() : RenderThreadPool::instance()->acquire();
+    m_quickRenderer->setAtlas(m_atlas);
+    if (m_hasThreadScheduling)
+        RenderThreadPool::instance()->setScheduling(m_quickRendererThread, m_threadScheduling);
 
     // Notify the render control that some scenegraph internals have to live on
     // m_quickRenderThread.
@@ -287,31 +767,51 @@ ZQuickWidget::ZQuickWidget(QWidget *parent)
     m_context->moveToThread(m_quickRendererThread);
     m_quickRenderer->moveToThread(m_quickRendererThread);
 
-    m_quickRendererThread->start();
-
-    // 现在不知道为啥，这两个信号都失效了
-    // Now hook up the signals. For simplicy we don't differentiate
-    // between renderRequested (only render is needed, no sync) and
-    // sceneChanged (polish and sync is needed too).
-    connect(m_renderControl, &QQuickRenderControl::renderRequested, this, &ZQuickWidget::requestUpdate);
+    // 以前看起来这两个信号“失效”，其实是渲染还没完成时的刷新请求被直接丢掉了，
+    // 以及polish期间再次发出的信号被m_psrRequested吞掉了。
+    // 现在渲染中到来的请求会登记为后续帧，等renderFinished之后再补一帧。
+    // renderRequested只需要render，sceneChanged需要polish+sync+render
+    // 渲染线程上发出的renderRequested来自Animator，由渲染线程自己处理（见RenderAnimationDriver），
+    // 关掉这个功能时才转到ui线程
+    connect(m_renderControl, &QQuickRenderControl::renderRequested, this, [this] {
+        if (QThread::currentThread() == thread())
+            requestRender();
+        else if (!m_quickRenderer->renderThreadAnimations())
+            QMetaObject::invokeMethod(this, &ZQuickWidget::requestRender, Qt::QueuedConnection);
+    }, Qt::DirectConnection);
     connect(m_renderControl, &QQuickRenderControl::sceneChanged,    this, &ZQuickWidget::requestUpdate);
+
+    m_startup.scene = (FrameTimings::now() - sceneStart) / 1e6;
 }
 
 ZQuickWidget::~ZQuickWidget()
 {
     // Release resources and move the context ownership back to this thread.
-    m_quickRenderer->mutex()->lock();
-    m_quickRenderer->requestStop();
-    m_quickRenderer->cond()->wait(m_quickRenderer->mutex());
-    m_quickRenderer->mutex()->unlock();
+    // 从来没有显示过的控件没有渲染线程
+    if (m_quickRendererThread) {
+        m_quickRenderer->mutex()->lock();
+        m_quickRenderer->requestStop();
+        m_quickRenderer->cond()->wait(m_quickRenderer->mutex());
+        m_quickRenderer->mutex()->unlock();
+
+        if (!m_atlas)
+            RenderThreadPool::instance()->release(m_quickRendererThread);
+    }
 
-    m_quickRendererThread->quit();
-    m_quickRendererThread->wait();
+    // 还没创建完的话中止，之后不会再回调
+    if (m_incubator) {
+        m_incubator->setStatusCallback(nullptr);
+        m_incubator->clear();
+        delete m_incubator;
+    }
 
+    // engine可能是共用的，根对象要在engine之前、自己这里删掉
+    // 组件归ComponentCache所有，不在这里删除
+    delete m_rootItem;
     delete m_renderControl;
-    delete m_qmlComponent;
     delete m_quickWindow;
-    delete m_qmlEngine;
+    if (m_ownsEngine)
+        delete m_qmlEngine;
 
     delete m_offscreenSurface;
     delete m_context;
@@ -319,35 +819,193 @@ ZQuickWidget::~ZQuickWidget()
     delete m_quickRenderer;
 }
 
+void ZQuickWidget::setPresentMode(PresentMode mode)
+{
+    if (m_quickInitialized) {
+        qWarning("ZQuickWidget: setPresentMode() must be called before setSource()");
+        return;
+    }
+
+    if (mode == GpuPresent && m_atlas) {
+        qWarning("ZQuickWidget: GpuPresent is not supported with an atlas compositor, using CpuPresent");
+        mode = CpuPresent;
+    }
+
+    if (mode == GpuPresent && !GlPresenter::isAvailable()) {
+        qWarning("ZQuickWidget: GpuPresent needs Qt::AA_ShareOpenGLContexts, using CpuPresent");
+        mode = CpuPresent;
+    }
+
+    m_presentMode = mode;
+
+    if (mode == GpuPresent && !m_presenter) {
+        m_presenter = new GlPresenter(&m_textureMailbox, this);
+        m_presenter->setFrameTimings(&m_timings);
+        m_presenter->setGeometry(rect());
+        // 加载完成之前先显示控件自己画的占位图
+        m_presenter->setVisible(m_rootItem != nullptr);
+        connect(m_presenter, &QOpenGLWidget::frameSwapped, this, [this] {
+            framePainted(m_presenter->presentedSequence());
+        });
+        m_quickRenderer->setTextureMailbox(&m_textureMailbox);
+    } else if (mode == CpuPresent && m_presenter) {
+        m_quickRenderer->setTextureMailbox(nullptr);
+        delete m_presenter;
+        m_presenter = nullptr;
+    }
+}
+
+void ZQuickWidget::setRenderThreadScheduling(const ThreadScheduling &scheduling)
+{
+    // 渲染线程还没分配时先记下来
+    m_hasThreadScheduling = true;
+    m_threadScheduling = scheduling;
+    if (m_quickRendererThread)
+        RenderThreadPool::instance()->setScheduling(m_quickRendererThread, scheduling);
+}
+
+void ZQuickWidget::setAtlasCompositor(AtlasCompositor *atlas)
+{
+    if (m_quickInitialized) {
+        qWarning("ZQuickWidget: setAtlasCompositor() must be called before setSource()");
+        return;
+    }
+
+    if (atlas && !atlas->isSupported())
+        atlas = nullptr;
+
+    // 图集读回的是CPU上的图像，纹理直接上屏用不上它
+    if (atlas && m_presentMode == GpuPresent)
+        setPresentMode(CpuPresent);
+
+    m_atlas = atlas;
+}
+
+void ZQuickWidget::setRenderThreadAnimations(bool enabled)
+{
+    if (m_quickInitialized) {
+        qWarning("ZQuickWidget: setRenderThreadAnimations() must be called before setSource()");
+        return;
+    }
+    m_quickRenderer->setRenderThreadAnimations(enabled);
+}
+
+ZQuick::FrameStats ZQuickWidget::frameStats() const
+{
+    return m_presenter ? m_textureMailbox.stats() : m_mailbox.stats();
+}
+
+QQmlEngine *ZQuickWidget::sharedEngine()
+{
+    // 随QCoreApplication一起销毁，使用它的控件需要在那之前销毁
+    static QPointer<QQmlEngine> engine;
+    if (!engine)
+        engine = new QQmlEngine(QCoreApplication::instance());
+    return engine;
+}
+
+ComponentCache *ZQuickWidget::warmUp(const QList<QUrl> &urls)
+{
+    ComponentCache *cache = ComponentCache::forEngine(sharedEngine());
+    cache->warmUp(urls);
+    return cache;
+}
+
 int ZQuickWidget::setSource(QUrl url)
 {
     mQmlFile = url.url();
 
     startQuick(mQmlFile);
 
-    // 目前无法正常接收场景刷新信号，只能通过一个定时器来刷新
-    QTimer *uTimer = new QTimer();
-    connect(uTimer, &QTimer::timeout, this, [=](){
-        requestUpdate();
-    });
-    uTimer->start(30);
-
     return 0;
 }
 
 void ZQuickWidget::requestUpdate()
 {
-    if (m_quickInitialized && !m_psrRequested) {
-        m_psrRequested = true;
+    scheduleUpdate(SyncUpdate);
+}
+
+void ZQuickWidget::requestRender()
+{
+    scheduleUpdate(RenderUpdate);
+}
+
+void ZQuickWidget::scheduleUpdate(int kind)
+{
+    if (!m_quickInitialized)
+        return;
+
+    // 同一时间只投递一个UPDATE事件，期间的请求合并到m_pendingUpdate里
+    const bool posted = m_pendingUpdate != 0;
+    m_pendingUpdate |= kind;
+    if (posted)
+        return;
+
+    // 离上一帧太近的话，等到帧率允许的时间再处理，这期间的请求都会合并进来
+    const int delay = m_governor->delayForNextFrame();
+    if (delay > 0)
+        m_frameTimer->start(delay);
+    else
         QCoreApplication::postEvent(this, new QEvent(UPDATE));
+}
+
+void ZQuickWidget::onRenderFinished()
+{
+    // 渲染期间有新的刷新请求，补上一帧
+    // takeFollowUp()是原子的，与deferUpdate()里的取回不会重复处理
+    if (const int kind = m_quickRenderer->takeFollowUp())
+        scheduleUpdate(kind);
+}
+
+void ZQuickWidget::deferUpdate(int kind)
+{
+    // 登记为后续帧，渲染线程结束当前帧后通知我们；
+    // 若渲染线程恰好已经结束，就由这里直接处理
+    bool merged = false;
+    const bool queued = m_quickRenderer->queueFollowUp(kind, &merged);
+    if (merged) {
+        if (m_presenter)
+            m_textureMailbox.markDropped();
+        else
+            m_mailbox.markDropped();
     }
+
+    if (!queued)
+        onRenderFinished();
 }
 
 bool ZQuickWidget::event(QEvent *e)
 {
     if (e->type() == UPDATE) {
-        polishSyncAndRender();
-        m_psrRequested = false;
+        // 先把这一帧攒下的输入送进去，它引起的sceneChanged会合并到m_pendingUpdate里，
+        // 赶得上这一帧
+        m_inputQueue.deliver(m_quickWindow);
+
+        // 先清掉标志再处理，polish期间新发出的信号能重新投递
+        const int kind = m_pendingUpdate & ~InputUpdate;
+        m_pendingUpdate = 0;
+
+        // 投递后场景没有变化的输入不计延迟；变了的等下一帧开始时标上帧序号
+        if (kind) {
+            for (qint64 receivedNs : qAsConst(m_queuedInput))
+                m_pendingInput.append({receivedNs, 0});
+        }
+        m_queuedInput.clear();
+
+        if (!kind) {
+            // 只有输入，场景没有变化
+        } else if (kind & SyncUpdate) {
+            polishSyncAndRender();
+        } else if (!m_quickRenderer->tryBeginFrame(QuickRenderer::Rendering)) {
+            // 先检查再设置的话，可能被渲染线程的动画帧抢先，覆盖掉它的状态
+            deferUpdate(kind);
+        } else {
+            // 序号在占住渲染线程之后分配，输入标记的就是真正带上它们的那一帧
+            const quint64 frame = m_quickRenderer->nextSequence();
+            tagInput(frame);
+            m_governor->frameStarted(m_quickRenderer->lastFrameCost());
+            m_quickRenderer->requestRenderOnly(frame);
+        }
         return true;
     } else if (e->type() == QEvent::Close) {
         // Avoid rendering on the render thread when the window is about to
@@ -358,79 +1016,143 @@ bool ZQuickWidget::event(QEvent *e)
         m_quickRenderer->aboutToQuit();
     }
 
+    switch (e->type()) {
+    case QEvent::TouchBegin:
+    case QEvent::TouchUpdate:
+    case QEvent::TouchEnd:
+    case QEvent::TouchCancel: {
+        // 触摸事件只有相对控件和全局的坐标，不需要换算，复制一份排队。
+        // 异步投递拿不到是否被接受，TouchBegin一律接受，
+        // 不接受触摸的item由QQuickWindow自己合成鼠标事件
+        const QTouchEvent *touch = static_cast<QTouchEvent *>(e);
+        QTouchEvent *mapped = new QTouchEvent(touch->type(), touch->device(), touch->modifiers(),
+                                              touch->touchPointStates(), touch->touchPoints());
+        mapped->setTimestamp(touch->timestamp());
+        postInput(mapped);
+        e->accept();
+        return true;
+    }
+    case QEvent::Enter: {
+        // 悬停由鼠标移动驱动（setMouseTracking），进入、离开也要让它知道
+        const QEnterEvent *enter = static_cast<QEnterEvent *>(e);
+        postInput(new QEnterEvent(enter->localPos(), enter->localPos(), enter->screenPos()));
+        break;
+    }
+    case QEvent::Leave:
+        postInput(new QEvent(QEvent::Leave));
+        break;
+    default:
+        break;
+    }
+
     return QWidget::event(e);
 }
 
+void ZQuickWidget::takeFrame()
+{
+    // 只取最新的一帧，中间被覆盖掉的帧不会再画，它们的变化区域已经合并进来了
+    if (!m_mailbox.consume())
+        return;
+
+    const RenderedFrame &frame = m_mailbox.readSlot();
+    m_timings.record(FrameTimings::Deliver, frame.sequence, frame.publishedNs, FrameTimings::now());
+
+    // 变化区域是图像像素坐标，换算成控件坐标，只重绘这些块
+    const qreal dpr = frame.image.devicePixelRatio();
+    QRegion dirty;
+    for (const QRect &r : frame.damage) {
+        dirty += QRectF(r.x() / dpr, r.y() / dpr, r.width() / dpr, r.height() / dpr)
+                .toAlignedRect();
+    }
+    update(dirty);
+}
+
 void ZQuickWidget::paintEvent(QPaintEvent *event)
 {
-    Q_UNUSED(event)
+    // 根对象创建出来、第一帧到达之前画占位图
+    if (!m_rootItem || (!m_presenter && m_mailbox.readSlot().image.isNull())) {
+        QPainter painter(this);
+        painter.fillRect(rect(), palette().window());
+        if (!m_placeholder.isNull()) {
+            const QSize size = m_placeholder.size() / m_placeholder.devicePixelRatio();
+            painter.drawPixmap(QRect(QPoint(0, 0), size).translated(rect().center() - QRect(QPoint(0, 0), size).center()),
+                               m_placeholder);
+        }
+        return;
+    }
+
+    // GpuPresent模式下由子控件GlPresenter负责显示
+    if (m_presenter)
+        return;
+
+    const RenderedFrame &frame = m_mailbox.readSlot();
+    const QImage &img = frame.image;
+    FrameTimings::Scope scope(&m_timings, FrameTimings::Paint, frame.sequence);
+
+    if (img.isNull())
+        return;
 
+    // 只画需要重绘的部分
     QPainter painter(this);
-    if(mImg.isNull() == false)
-    {
-        painter.drawImage(0, 0, mImg);
+    const qreal dpr = img.devicePixelRatio();
+    for (const QRect &r : event->region()) {
+        const QRectF source(r.x() * dpr, r.y() * dpr, r.width() * dpr, r.height() * dpr);
+        painter.drawImage(QRectF(r), img, source);
     }
+    painter.end();
+
+    framePainted(frame.sequence);
 }
 
 void ZQuickWidget::polishSyncAndRender()
 {
-    qDebug() << "processing:"
-             << m_quickRenderer->mProcessState
-             << m_quickRenderer->mHasPostRender;
-
-    // 假如还在渲染中，就等待渲染完成后再处理
-    // 期间不断处理其他事件（键盘、鼠标、绘制等）
-    // while (m_quickRenderer->mProcessState > 0 && m_quickRenderer->mProcessState != 3) {
-    //     qApp->processEvents();
-    //     // return;
-    // }
+    // 拖动改变尺寸时会连续来很多resizeEvent，这里每帧只应用最后一次
+    if (m_resizePending) {
+        m_resizePending = false;
+        updateSizes();
+    }
 
-    // 假如还在渲染，
-    if(m_quickRenderer->mHasPostRender == true)
+    // 假如上一帧还在render/读取（或者渲染线程正在画动画帧），
+    // 占住渲染线程要一步完成，先检查isBusy()再设置状态会与渲染线程的动画帧竞争
+    if (!m_quickRenderer->tryBeginFrame(QuickRenderer::SyncPending))
     {
-        // // 处理其他事情
-        // qApp->processEvents();
-
-        // 就直接返回
+        // 先把这一帧的polish做掉，与渲染线程并行；
+        // sync要等上一帧结束，登记为后续帧，不会丢失也不阻塞ui线程。
+        // 之后真正sync时会再polish一次，没有新变化的话几乎不耗时
+        // 真正的序号要等占住渲染线程时才分配，这里记的是估计值
+        FrameTimings::Scope scope(&m_timings, FrameTimings::Polish, m_quickRenderer->lastSequence() + 1);
+        m_renderControl->polishItems();
+        deferUpdate(SyncUpdate);
         return;
     }
 
-    QElapsedTimer timer;
-    timer.start();
-
-    // qDebug() << "主窗口请求渲染";
+    const quint64 frame = m_quickRenderer->nextSequence();
+    const qint64 guiStart = FrameTimings::now();
+    tagInput(frame);
+    m_governor->frameStarted(m_quickRenderer->lastFrameCost());
 
     // Q_ASSERT(QThread::currentThread() == thread());
 
     // 不执行polishItems，3d场景就渲染不出来
     // // Polishing happens on the gui thread.
-    m_renderControl->polishItems(); // 这个耗时很厉害
-
-    qDebug() << "主窗口渲染耗时-->a:" << timer.elapsed();
+    {
+        FrameTimings::Scope scope(&m_timings, FrameTimings::Polish, frame);
+        m_renderControl->polishItems(); // 这个耗时很厉害
+    }
 
     // Sync happens on the render thread with the gui thread (this one) blocked.
-    QMutexLocker lock(m_quickRenderer->mutex());
-    m_quickRenderer->requestRender(); // 发起渲染申请
-
-    qDebug() << "主窗口渲染耗时-->b:" << timer.elapsed();
-
-    // timer.start();
-
-    // 这里好像不怎么耗时。。。。。
-    // Wait until sync is complete.
-    m_quickRenderer->cond()->wait(m_quickRenderer->mutex());
-
-    // // 好像 QWaitCondition::wait 会有 unlock的效果？
-    // // 是不是需要unlock一下？
-    // // 前面不用QMutexLocker就行
-    // while (m_quickRenderer->mFinished == false) {
-    //     qApp->processEvents();
-    //     // qDebug() << m_quickRenderer->mProcessState
-    //     //          << m_quickRenderer->mHasPostRender;
-    //     // QThread::msleep(100);
-    // }
-
-    qDebug() << "主窗口渲染耗时:" << timer.elapsed();
+    {
+        FrameTimings::Scope scope(&m_timings, FrameTimings::SyncWait, frame);
+        QMutexLocker lock(m_quickRenderer->mutex());
+        m_quickRenderer->setNextFrame(frame);
+        m_quickRenderer->setTargetSize(size() * devicePixelRatioF(), devicePixelRatioF());
+        m_quickRenderer->requestRender(); // 发起渲染申请
+
+        // 这里好像不怎么耗时。。。。。
+        // Wait until sync is complete.
+        m_quickRenderer->cond()->wait(m_quickRenderer->mutex());
+    }
+    m_governor->addGuiCost(FrameTimings::now() - guiStart);
 
     // without blocking？ 前面的wait不是已经bloking了吗？
     // Rendering happens on the render thread without blocking the gui (main)
@@ -440,29 +1162,66 @@ void ZQuickWidget::polishSyncAndRender()
 
 void ZQuickWidget::run()
 {
-    qDebug() << "status changed:" << m_qmlComponent->status();
-
     disconnect(m_qmlComponent, &QQmlComponent::statusChanged, this, &ZQuickWidget::run);
 
     if (m_qmlComponent->isError()) {
         const QList<QQmlError> errorList = m_qmlComponent->errors();
         for (const QQmlError &error : errorList)
             qWarning() << error.url() << error.line() << error;
+        setStatus(Error);
         return;
     }
 
-    QObject *rootObject = m_qmlComponent->create();
-    if (m_qmlComponent->isError()) {
-        const QList<QQmlError> errorList = m_qmlComponent->errors();
-        for (const QQmlError &error : errorList)
-            qWarning() << error.url() << error.line() << error;
+    if (m_startup.compile < 0)
+        m_startup.compile = (FrameTimings::now() - m_compileStartNs) / 1e6;
+
+    // 还没显示过，等showEvent里创建好窗口再创建根对象
+    if (!m_quickWindow) {
+        m_createPending = true;
         return;
     }
+    createRootObject();
+}
+
+void ZQuickWidget::createRootObject()
+{
+    m_createStartNs = FrameTimings::now();
+
+    // 不再用create()一次创建完：大场景要几百毫秒，期间整个程序都卡住。
+    // 交给incubator分片创建，每帧只占用一小段ui线程时间
+    m_incubator = new Incubator(m_asynchronousLoading ? QQmlIncubator::Asynchronous
+                                                      : QQmlIncubator::Synchronous);
+    m_incubator->setInitialStateCallback([this](QObject *object) {
+        // 在completed之前挂到窗口上并设好尺寸，创建完不用再重新布局一遍
+        if (QQuickItem *item = qobject_cast<QQuickItem *>(object)) {
+            item->setParentItem(m_quickWindow->contentItem());
+            item->setSize(size());
+        }
+    });
+    m_incubator->setStatusCallback([this](QQmlIncubator::Status status) {
+        if (status == QQmlIncubator::Ready) {
+            rootObjectCreated(m_incubator->object());
+        } else if (status == QQmlIncubator::Error) {
+            const QList<QQmlError> errorList = m_incubator->errors();
+            for (const QQmlError &error : errorList)
+                qWarning() << error.url() << error.line() << error;
+            setStatus(Error);
+        }
+    });
+    m_qmlComponent->create(*m_incubator);
+}
+
+void ZQuickWidget::rootObjectCreated(QObject *rootObject)
+{
+    m_readyNs = FrameTimings::now();
+    if (m_startup.create < 0)
+        m_startup.create = (m_readyNs - m_createStartNs) / 1e6;
 
     m_rootItem = qobject_cast<QQuickItem *>(rootObject);
     if (!m_rootItem) {
         qWarning("run: Not a QQuickItem");
         delete rootObject;
+        setStatus(Error);
         return;
     }
 
@@ -477,6 +1236,11 @@ void ZQuickWidget::run()
     // Initialize the render thread and perform the first polish/sync/render.
     m_quickRenderer->requestInit();
     polishSyncAndRender();
+
+    // 占位图换成真正的画面
+    if (m_presenter)
+        m_presenter->show();
+    setStatus(Ready);
 }
 
 void ZQuickWidget::updateSizes()
@@ -488,63 +1252,201 @@ void ZQuickWidget::updateSizes()
     m_quickWindow->setGeometry(0, 0, width(), height());
 }
 
+void ZQuickWidget::setStatus(Status status)
+{
+    if (m_status == status)
+        return;
+    m_status = status;
+    update();
+    emit statusChanged(status);
+}
+
+void ZQuickWidget::setIncubationBudget(int msecs)
+{
+    if (IncubationController *controller = IncubationController::forEngine(ensureEngine()))
+        controller->setBudget(msecs);
+}
+
+int ZQuickWidget::incubationBudget() const
+{
+    IncubationController *controller = IncubationController::forEngine(engine());
+    return controller ? controller->budget() : -1;
+}
+
 void ZQuickWidget::startQuick(const QString &filename)
 {
-    m_qmlComponent = new QQmlComponent(m_qmlEngine, QUrl(filename));
+    // 再次setSource时，丢掉上一次还没创建完的对象
+    if (m_incubator) {
+        m_incubator->setStatusCallback(nullptr);
+        m_incubator->clear();
+        delete m_incubator;
+        m_incubator = nullptr;
+    }
+    m_createPending = false;
+    setStatus(Loading);
+
+    // 同一engine上打开过的qml不用再解析、编译一遍
+    // 异步加载时编译也放到QML的加载线程上，ui线程只在编译完成后创建对象
+    m_compileStartNs = FrameTimings::now();
+    m_qmlComponent = ComponentCache::forEngine(ensureEngine())->component(QUrl(filename),
+            m_asynchronousLoading ? QQmlComponent::Asynchronous : QQmlComponent::PreferSynchronous);
+
+    // 编译在加载线程上进行的同时，在ui线程上创建GL上下文和窗口；
+    // 隐藏的控件（例如没有切换到的标签页）等第一次显示时再创建
+    if (isVisible())
+        ensureScene();
+
     if (m_qmlComponent->isLoading())
         connect(m_qmlComponent, &QQmlComponent::statusChanged, this, &ZQuickWidget::run);
     else
         run();
 }
 
+void ZQuickWidget::showEvent(QShowEvent *e)
+{
+    QWidget::showEvent(e);
+
+    if (m_qmlComponent && !m_quickWindow)
+        ensureScene();
+    if (m_createPending) {
+        m_createPending = false;
+        createRootObject();
+    }
+}
+
 void ZQuickWidget::resizeEvent(QResizeEvent *)
 {
+    if (m_presenter)
+        m_presenter->setGeometry(rect());
+
     // If this is a resize after the scene is up and running, recreate the fbo and the
     // Quick item and scene.
+    // 不再同步地渲染每一个中间尺寸，只记下来，和其他刷新请求合并成一帧
     if (m_rootItem) {
-        updateSizes();
-        m_quickRenderer->requestResize();
-        polishSyncAndRender();
+        m_resizePending = true;
+        scheduleUpdate(SyncUpdate);
+    }
+}
+
+void ZQuickWidget::postInput(QEvent *e)
+{
+    // 场景还没加载好，输入没有意义
+    if (!m_quickInitialized) {
+        delete e;
+        return;
+    }
+
+    // 不再立即sendEvent，攒到下一帧之前一起投递，连续的移动、滚轮会被合并
+    m_queuedInput.append(FrameTimings::now());
+    m_inputQueue.post(e);
+    scheduleUpdate(InputUpdate);
+}
+
+void ZQuickWidget::tagInput(quint64 frame)
+{
+    for (PendingInput &input : m_pendingInput) {
+        if (!input.frame)
+            input.frame = frame;
     }
 }
 
+void ZQuickWidget::framePainted(quint64 sequence)
+{
+    if (sequence && m_startup.total < 0) {
+        const qint64 now = FrameTimings::now();
+        m_startup.firstFrame = (now - m_readyNs) / 1e6;
+        m_startup.total = (now - m_constructedNs) / 1e6;
+        emit firstFramePresented();
+    }
+
+    if (m_pendingInput.isEmpty())
+        return;
+
+    // 被合并掉的帧不会单独上屏，序号不超过当前帧的输入都在这一帧里了
+    const qint64 now = FrameTimings::now();
+    auto done = [&](const PendingInput &input) {
+        if (!input.frame || input.frame > sequence)
+            return false;
+        m_inputLatency.record((now - input.receivedNs) / 1000);
+        return true;
+    };
+    m_pendingInput.erase(std::remove_if(m_pendingInput.begin(), m_pendingInput.end(), done),
+                         m_pendingInput.end());
+
+    // 渲染结果与上一帧相同时不会上屏，这些输入永远等不到，不能无限堆积
+    const qint64 staleNs = 1000 * 1000 * 1000;
+    auto stale = [&](const PendingInput &input) { return now - input.receivedNs > staleNs; };
+    m_pendingInput.erase(std::remove_if(m_pendingInput.begin(), m_pendingInput.end(), stale),
+                         m_pendingInput.end());
+}
+
+// Use the constructor taking localPos and screenPos. That puts localPos into the
+// event's localPos and windowPos, and screenPos into the event's screenPos. This way
+// the windowPos in e is ignored and is replaced by localPos. This is necessary
+// because QQuickWindow thinks of itself as a top-level window always.
+static QMouseEvent *mapMouseEvent(const QMouseEvent *e)
+{
+    QMouseEvent *mapped = new QMouseEvent(e->type(), e->localPos(), e->screenPos(),
+                                          e->button(), e->buttons(), e->modifiers());
+    mapped->setTimestamp(e->timestamp());
+    return mapped;
+}
+
 void ZQuickWidget::mousePressEvent(QMouseEvent *e)
 {
-    // Use the constructor taking localPos and screenPos. That puts localPos into the
-    // event's localPos and windowPos, and screenPos into the event's screenPos. This way
-    // the windowPos in e is ignored and is replaced by localPos. This is necessary
-    // because QQuickWindow thinks of itself as a top-level window always.
-    QMouseEvent mappedEvent(e->type(), e->localPos(), e->screenPos(), e->button(), e->buttons(), e->modifiers());
-    QCoreApplication::sendEvent(m_quickWindow, &mappedEvent);
+    postInput(mapMouseEvent(e));
 }
 
 void ZQuickWidget::mouseReleaseEvent(QMouseEvent *e)
 {
-    QMouseEvent mappedEvent(e->type(), e->localPos(), e->screenPos(), e->button(), e->buttons(), e->modifiers());
-    QCoreApplication::sendEvent(m_quickWindow, &mappedEvent);
+    postInput(mapMouseEvent(e));
 }
 
 void ZQuickWidget::mouseMoveEvent(QMouseEvent *e)
 {
-    QMouseEvent mappedEvent(e->type(),
-                            e->localPos(),
-                            e->screenPos(),
-                            e->button(),
-                            e->buttons(),
-                            e->modifiers());
-    QCoreApplication::sendEvent(m_quickWindow, &mappedEvent);
+    postInput(mapMouseEvent(e));
+}
+
+void ZQuickWidget::mouseDoubleClickEvent(QMouseEvent *e)
+{
+    postInput(mapMouseEvent(e));
 }
 
 void ZQuickWidget::wheelEvent(QWheelEvent *e)
 {
-    QWheelEvent mappedEvent(e->position(),
-                            e->globalPosition(),
-                            e->pixelDelta(),
-                            e->angleDelta(),
-                            e->buttons(),
-                            e->modifiers(),
-                            e->phase(),
-                            e->inverted(),
-                            e->source());
-    QCoreApplication::sendEvent(m_quickWindow, &mappedEvent);
+    QWheelEvent *mapped = new QWheelEvent(e->position(),
+                                          e->globalPosition(),
+                                          e->pixelDelta(),
+                                          e->angleDelta(),
+                                          e->buttons(),
+                                          e->modifiers(),
+                                          e->phase(),
+                                          e->inverted(),
+                                          e->source());
+    mapped->setTimestamp(e->timestamp());
+    postInput(mapped);
+}
+
+void ZQuickWidget::keyPressEvent(QKeyEvent *e)
+{
+    QKeyEvent *mapped = new QKeyEvent(e->type(), e->key(), e->modifiers(),
+                                      e->nativeScanCode(), e->nativeVirtualKey(), e->nativeModifiers(),
+                                      e->text(), e->isAutoRepeat(), e->count());
+    mapped->setTimestamp(e->timestamp());
+    postInput(mapped);
+}
+
+void ZQuickWidget::keyReleaseEvent(QKeyEvent *e)
+{
+    keyPressEvent(e);
+}
+
+void ZQuickWidget::focusInEvent(QFocusEvent *e)
+{
+    postInput(new QFocusEvent(e->type(), e->reason()));
+}
+
+void ZQuickWidget::focusOutEvent(QFocusEvent *e)
+{
+    postInput(new QFocusEvent(e->type(), e->reason()));
 }
@@ -11,6 +11,22 @@
 #include <QQmlEngine>
 #include <QQuickWidget>
 #include <QOpenGLWidget>
+#include <QAtomicInt>
+#include <QPixmap>
+
+#include "zframereadback.h"
+#include "zgpuconvertpass.h"
+#include "zframemailbox.h"
+#include "zglpresenter.h"
+#include "zframetimings.h"
+#include "zframediff.h"
+#include "zframerategovernor.h"
+#include "zframesink.h"
+#include "zinputqueue.h"
+#include "zlatencyhistogram.h"
+#include "zrenderthreadpool.h"
+#include "zincubationcontroller.h"
+#include "zcomponentcache.h"
 
 QT_FORWARD_DECLARE_CLASS(QOpenGLContext)
 QT_FORWARD_DECLARE_CLASS(QOpenGLFramebufferObject)
@@ -20,22 +36,44 @@ QT_FORWARD_DECLARE_CLASS(QQuickWindow)
 QT_FORWARD_DECLARE_CLASS(QQmlEngine)
 QT_FORWARD_DECLARE_CLASS(QQmlComponent)
 QT_FORWARD_DECLARE_CLASS(QQuickItem)
+QT_FORWARD_DECLARE_CLASS(QTimer)
 
 #ifdef Q_OS_WIN
 #pragma execution_character_set("utf-8")
 #endif
 
 namespace ZQuick {
+class AtlasCompositor;
+class RenderAnimationDriver;
+
 class QuickRenderer : public QObject
 {
     Q_OBJECT
 
 public:
+    // 渲染结果读回CPU的方式
+    enum ReadbackMode {
+        GrabReadback,   // glReadPixels，同步读取
+        PboReadback     // PBO + fence异步读取，不支持时自动退回GrabReadback
+    };
+
+    // 一帧在渲染线程上的状态，ui线程据此决定是否可以发起下一帧
+    enum FrameState {
+        Idle,           // 空闲，可以发起新的一帧
+        SyncPending,    // 已请求sync，ui线程正在等待
+        Syncing,        // 正在sync，ui线程被阻塞
+        Rendering       // sync已完成，正在render/读取，ui线程可以polish下一帧
+    };
+
     QuickRenderer();
 
     void requestInit();
+    // ui线程发起一帧之前调用：渲染线程空闲时原子地占住它（Idle -> state）并返回true；
+    // 返回false说明有一帧正在进行或排队（可能是渲染线程自己的动画帧），调用者应登记为后续帧
+    bool tryBeginFrame(FrameState state) { return m_frameState.testAndSetOrdered(Idle, state); }
+    // 以下两个需先tryBeginFrame(SyncPending)/tryBeginFrame(Rendering)成功
     void requestRender();
-    void requestResize();
+    void requestRenderOnly(quint64 frame);
     void requestStop();
 
     QWaitCondition *cond() { return &m_cond; }
@@ -46,24 +84,85 @@ public:
     void setQuickWindow(QQuickWindow *w) { m_quickWindow = w; }
     void setRenderControl(QQuickRenderControl *r) { m_renderControl = r; }
 
-    void setWidget(QWidget *w) {m_widget = w;}
+    void setMailbox(ImageMailbox *m) { m_mailbox = m; }
+    void setFrameTimings(FrameTimings *t) { m_timings = t; }
+    // 分配帧序号，每个上屏的帧（sync、只render、渲染线程的动画帧）各占一个，
+    // ui线程和渲染线程都会调用，序号单调递增
+    quint64 nextSequence() { return m_sequence.fetchAndAddOrdered(1) + 1; }
+    quint64 lastSequence() const { return m_sequence.loadAcquire(); }
+    // ui线程在请求sync时设置（持有mutex），渲染线程在sync时读取
+    void setNextFrame(quint64 frame) { m_nextFrame = frame; }
+    // 渲染尺寸（像素）和缩放比，与setNextFrame一样在请求sync时设置，sync时生效
+    void setTargetSize(const QSize &pixelSize, qreal dpr) { m_nextSize = pixelSize; m_nextDpr = dpr; }
+    // 设置后不再读回CPU，直接把纹理交给ui线程，需在requestInit之前设置
+    void setTextureMailbox(TextureMailbox *m) { m_textureMailbox = m; }
+    // 设置后画面拷进合成器的图集，与其它控件一起读回；需在合成器的线程上运行，
+    // 上下文要在全局共享组里，需在requestInit之前设置
+    void setAtlas(AtlasCompositor *atlas) { m_atlas = atlas; }
+    // 合成器读回之后在渲染线程上调用，image是图集里属于这个控件的一块
+    void publishSlice(const QImage &image, quint64 sequence);
+
+    // 渲染线程上的Animator由RenderAnimationDriver推进，并由渲染线程自己发起只render的帧，
+    // 不经过ui线程；默认打开，需在requestInit之前设置
+    void setRenderThreadAnimations(bool enabled) { m_renderThreadAnimations = enabled; }
+    bool renderThreadAnimations() const { return m_renderThreadAnimations; }
+    // RenderAnimationDriver推进动画之后在渲染线程上调用
+    void renderAnimationFrame();
+
+    // 可以在任意线程、任意时候增删；只有读回CPU的帧才会通知
+    void addFrameSink(FrameSink *sink);
+    void removeFrameSink(FrameSink *sink);
+
+    // 关闭后每帧都整幅投递，即使与上一帧相同，需在requestInit之前设置
+    void setDamageTracking(bool enabled) { m_damageTracking = enabled; }
+
+    void setReadbackMode(ReadbackMode mode) { m_readbackMode.storeRelaxed(mode); }
+    ReadbackMode readbackMode() const { return ReadbackMode(m_readbackMode.loadRelaxed()); }
+
+    // 读回之前先在GPU上翻转、换通道，读出的数据直接拷进QImage，CPU不再转换
+    // 适合CPU很弱的嵌入式平台；会多一次全屏的绘制
+    void setGpuConvert(bool enabled) { m_gpuConvert.storeRelaxed(enabled); }
+    bool gpuConvert() const { return m_gpuConvert.loadRelaxed(); }
 
 
     void aboutToQuit();
 
-    volatile int mProcessState = 0;
-    volatile bool mFinished = false;
-    volatile bool mHasPostRender = false;
+    FrameState frameState() const { return FrameState(m_frameState.loadAcquire()); }
+    bool isBusy() const { return frameState() != Idle; }
+    // 上一帧在渲染线程上从开始到结束的耗时，纳秒
+    qint64 lastFrameCost() const { return m_lastFrameCost.loadAcquire(); }
+
+    // ui线程调用：当前帧没结束时登记一个后续帧（多次登记会合并为一帧），
+    // 返回false表示当前帧已经结束，调用者需自己takeFollowUp()处理
+    bool queueFollowUp(int kind, bool *merged = nullptr);
+    int takeFollowUp();
 
 signals:
-    void rendered(QImage img);
+    // 信箱里有新帧了，同一时间最多只会有一个未处理的通知
+    void frameAvailable();
+    // 一帧结束且登记了后续帧时发出
+    void renderFinished();
+    // 渲染线程上makeCurrent或创建fbo失败，这一帧不会产生结果
+    void renderFailed(quint64 frame);
+
+private slots:
+    void drainReadback();
+    void onRenderRequested();
 
 private:
     bool event(QEvent *e) override;
     void init();
     void cleanup();
-    void ensureFbo();
-    void render(QMutexLocker *lock);
+    bool ensureFbo();
+    bool render(QMutexLocker *lock);
+    void renderPhase();
+    void renderOnly(quint64 frame);
+    void present();
+    void finishFrame();
+    void readback();
+    bool blitToAtlas();
+    void publishFrame(quint64 sequence);
+    void publishTexture();
 
     QWaitCondition m_cond;
     QMutex m_mutex;
@@ -75,7 +174,54 @@ private:
     QMutex m_quitMutex;
     bool m_quit;
 
-    QWidget *m_widget;
+    ImageMailbox *m_mailbox;
+    TextureMailbox *m_textureMailbox;
+    AtlasCompositor *m_atlas;
+    bool m_renderThreadAnimations;
+    RenderAnimationDriver *m_animationDriver;
+    FrameTimings *m_timings;
+    QAtomicInteger<quint64> m_sequence;
+    quint64 m_nextFrame;
+    quint64 m_renderOnlyFrame;  // requestRenderOnly时设置，事件投递保证渲染线程能看到
+    quint64 m_currentFrame;
+    QSize m_nextSize;
+    qreal m_nextDpr;
+    QSize m_targetSize;     // 渲染线程上当前使用的尺寸，fbo可能比它大
+    qreal m_dpr;
+
+    QAtomicInt m_readbackMode;
+    FrameReadback m_readback;
+    QByteArray m_readPixels;    // GrabReadback时glReadPixels的目标
+    QAtomicInt m_gpuConvert;
+    GpuConvertPass m_convertPass;
+    QTimer *m_drainTimer;
+    int m_drainRetries;
+
+    QMutex m_sinkMutex;
+    QVector<FrameSink *> m_sinks;
+
+    bool m_damageTracking;
+    FrameDiff m_diff;
+    QRegion m_lastDamage;
+
+    QAtomicInt m_frameState;
+    QAtomicInt m_followUp;
+    qint64 m_frameStartNs;
+    QAtomicInteger<qint64> m_lastFrameCost;
+};
+
+// 从控件构造到第一帧上屏的各阶段耗时，单位毫秒；还没经过的阶段为-1
+// 编译在加载线程上进行，与context、scene是重叠的，各项之和可能大于total；
+// 控件隐藏期间不创建任何东西，这段等待时间只计入total
+struct StartupTimings
+{
+    double engine = -1;         // 创建QQmlEngine，使用外部engine时为-1
+    double compile = -1;        // setSource到组件编译完成，预热过的几乎为0
+    double context = -1;        // 创建GL上下文和离屏surface
+    double scene = -1;          // 创建QQuickWindow、QQuickRenderControl，分配渲染线程
+    double create = -1;         // 分片创建根对象
+    double firstFrame = -1;     // 根对象就绪到第一帧上屏：初始化、polish、sync、render、读回
+    double total = -1;          // 构造到第一帧上屏
 };
 
 }
@@ -86,23 +232,120 @@ class ZQuickWidget : public QWidget
     Q_OBJECT
 
 public:
+    // 画面的显示方式
+    enum PresentMode {
+        CpuPresent,     // 读回QImage，再用QPainter画出来
+        GpuPresent      // 子控件QOpenGLWidget直接采样渲染线程的纹理，不经过CPU
+    };
+
+    // 场景的加载状态
+    enum Status {
+        Null,           // 还没有setSource
+        Loading,        // 正在加载、编译或者分片创建对象
+        Ready,          // 根item已创建，开始渲染
+        Error
+    };
+
     ZQuickWidget(QWidget *parent = nullptr);
+    // 使用外部的engine（例如sharedEngine()），控件不负责销毁它
+    ZQuickWidget(QQmlEngine *engine, QWidget *parent = nullptr);
     ~ZQuickWidget();
 
-    QQmlEngine *engine() const{return m_qmlEngine;}
+    // 同一ui线程上所有控件可以共用的engine
+    static QQmlEngine *sharedEngine();
+    // 程序启动时在共用engine上后台编译这些qml，之后使用sharedEngine()的控件
+    // 第一次打开它们时不用再等解析、编译和插件加载；返回的缓存可以取每个url的编译耗时
+    static ZQuick::ComponentCache *warmUp(const QList<QUrl> &urls);
+
+    // GL上下文、离屏窗口和渲染线程在第一次显示并且有source时才创建，
+    // engine在第一次用到时创建；没有显示过的控件quickWindow()返回nullptr
+    QQmlEngine *engine() const;
     QQuickWindow *quickWindow() const{return m_quickWindow;}
-    QQmlContext *rootContext() const{return m_qmlEngine->rootContext();}
+    QQmlContext *rootContext() const{return engine()->rootContext();}
     QQuickItem *rootObject() const{return m_rootItem;}
     void setResizeMode(QQuickWidget::ResizeMode mode){}
 
+    // 默认使用PBO异步读取，驱动不支持时会自动退回grabWindow
+    void setReadbackMode(ZQuick::QuickRenderer::ReadbackMode mode) { m_quickRenderer->setReadbackMode(mode); }
+    ZQuick::QuickRenderer::ReadbackMode readbackMode() const { return m_quickRenderer->readbackMode(); }
+
+    // 默认在CPU上翻转、换通道；打开后改在GPU上做
+    void setGpuConvert(bool enabled) { m_quickRenderer->setGpuConvert(enabled); }
+    bool gpuConvert() const { return m_quickRenderer->gpuConvert(); }
+
+    // GpuPresent需要在创建QApplication之前设置Qt::AA_ShareOpenGLContexts，
+    // 否则自动退回CpuPresent；需在setSource之前调用
+    void setPresentMode(PresentMode mode);
+    PresentMode presentMode() const { return m_presentMode; }
+
+    ZQuick::FrameStats frameStats() const;
+    // 收到的输入事件数和合并后真正送给qml的事件数
+    ZQuick::InputStats inputStats() const { return m_inputQueue.stats(); }
+    // 输入到上屏的延迟：从控件收到输入事件，到第一帧包含它的画面画完（GpuPresent下为交换缓冲）。
+    // 没有引起画面变化的输入不计入
+    const ZQuick::LatencyHistogram &inputLatency() const { return m_inputLatency; }
+    void resetInputLatency() { m_inputLatency.reset(); }
+
+    // 各阶段耗时记录，可取百分位数或导出Chrome trace
+    ZQuick::FrameTimings *frameTimings() { return &m_timings; }
+
+    // 额外接收每一帧（例如FrameRecorder），仅CpuPresent模式下有效
+    void addFrameSink(ZQuick::FrameSink *sink) { m_quickRenderer->addFrameSink(sink); }
+    void removeFrameSink(ZQuick::FrameSink *sink) { m_quickRenderer->removeFrameSink(sink); }
+
+    // 本控件渲染线程的优先级、CPU亲和性、调度策略和线程名，可在运行中修改，只改设置了的项；
+    // 渲染线程被多个控件共用时，每一项以最后一次设置为准；使用合成器时设置的是合成器的线程。
+    // 所有渲染线程的默认设置见RenderThreadPool::setScheduling()
+    void setRenderThreadScheduling(const ZQuick::ThreadScheduling &scheduling);
+
+    // 与同一个合成器上的其它控件共用渲染线程，每轮只读回一次，见AtlasCompositor；
+    // 需在setSource之前调用，需要Qt::AA_ShareOpenGLContexts，不支持GpuPresent。使用合成器时渲染线程的调度设置对它们都生效
+    void setAtlasCompositor(ZQuick::AtlasCompositor *atlas);
+    ZQuick::AtlasCompositor *atlasCompositor() const { return m_atlas; }
+
+    // 默认Animator在渲染线程上推进，ui线程忙的时候转圈、进度之类的动画照样流畅；
+    // 关掉后每一帧都要经过ui线程发起。需在setSource之前调用
+    void setRenderThreadAnimations(bool enabled);
+    bool renderThreadAnimations() const { return m_quickRenderer->renderThreadAnimations(); }
+
+    // 帧率控制：目标/最高/最低帧率，以及当前帧率和原因
+    ZQuick::FrameRateGovernor *frameRateGovernor() const { return m_governor; }
+
     int setSource(QUrl url);
+    Status status() const { return m_status; }
+    // 启动耗时，firstFramePresented之后完整
+    ZQuick::StartupTimings startupTimings() const { return m_startup; }
+
+    // 默认异步创建根对象：每帧只花一小段时间（见setIncubationBudget），不会卡住ui线程；
+    // 关掉后在setSource里一次创建完
+    void setAsynchronousLoading(bool enabled) { m_asynchronousLoading = enabled; }
+    bool asynchronousLoading() const { return m_asynchronousLoading; }
+    // 每帧用于创建对象的时间，单位毫秒；同一engine上的控件共用这个设置
+    void setIncubationBudget(int msecs);
+    int incubationBudget() const;
+
+    // 加载完成之前显示的图片，居中画在背景色上；不设置时只画背景色
+    void setPlaceholder(const QPixmap &pixmap) { m_placeholder = pixmap; update(); }
+    QPixmap placeholder() const { return m_placeholder; }
+
+signals:
+    void statusChanged(ZQuickWidget::Status status);
+    // 异步创建期间每执行一片发出一次，pendingObjects为还在创建中的对象数（包括异步的Loader）
+    void loadingProgress(int pendingObjects);
+    void firstFramePresented();
 
 protected:
+    void showEvent(QShowEvent *e) override;
     void resizeEvent(QResizeEvent *e) override;
     void mousePressEvent(QMouseEvent *e) override;
     void mouseReleaseEvent(QMouseEvent *e) override;
     void mouseMoveEvent(QMouseEvent *e) override;
+    void mouseDoubleClickEvent(QMouseEvent *e) override;
     void wheelEvent(QWheelEvent *e) override;
+    void keyPressEvent(QKeyEvent *e) override;
+    void keyReleaseEvent(QKeyEvent *e) override;
+    void focusInEvent(QFocusEvent *e) override;
+    void focusOutEvent(QFocusEvent *e) override;
     bool event(QEvent *e) override;
 
     void paintEvent(QPaintEvent *event) override;
@@ -110,12 +353,31 @@ protected:
 private slots:
     void run();
     void requestUpdate();
+    void requestRender();
+    void onRenderFinished();
     void polishSyncAndRender();
 
 
 private:
+    QQmlEngine *ensureEngine();
+    void ensureScene();
     void startQuick(const QString &filename);
+    void createRootObject();
     void updateSizes();
+    void scheduleUpdate(int kind);
+    void deferUpdate(int kind);
+    void takeFrame();
+    void postInput(QEvent *e);
+    void setStatus(Status status);
+    void rootObjectCreated(QObject *rootObject);
+    void tagInput(quint64 frame);
+    void framePainted(quint64 sequence);
+
+    enum UpdateKind {
+        RenderUpdate = 0x1,     // 只需要render
+        SyncUpdate   = 0x2,     // 需要polish + sync + render
+        InputUpdate  = 0x4      // 有待投递的输入，投递之后场景变了才需要渲染
+    };
 
     ZQuick::QuickRenderer *m_quickRenderer;
     QThread *m_quickRendererThread;
@@ -128,10 +390,46 @@ private:
     QQmlComponent *m_qmlComponent;
     QQuickItem *m_rootItem;
     bool m_quickInitialized;
-    bool m_psrRequested;
+    int m_pendingUpdate;    // 已投递UPDATE事件、还没处理的请求
+    bool m_resizePending;   // 尺寸变了，下一次polish前再更新场景
 
     QString mQmlFile;
-    QImage mImg;
+    ZQuick::ImageMailbox m_mailbox;
+    ZQuick::TextureMailbox m_textureMailbox;
+    ZQuick::GlPresenter *m_presenter;
+    PresentMode m_presentMode;
+    ZQuick::AtlasCompositor *m_atlas;
+    bool m_ownsEngine;
+
+    ZQuick::FrameTimings m_timings;
+
+    ZQuick::Incubator *m_incubator;
+    Status m_status;
+    bool m_asynchronousLoading;
+    QPixmap m_placeholder;
+
+    bool m_engineReady;
+    bool m_hasThreadScheduling;
+    ZQuick::ThreadScheduling m_threadScheduling;
+    bool m_createPending;   // 组件已编译好，等第一次显示再创建根对象
+    ZQuick::StartupTimings m_startup;
+    qint64 m_constructedNs;
+    qint64 m_compileStartNs;
+    qint64 m_createStartNs;
+    qint64 m_readyNs;
+
+    ZQuick::InputQueue m_inputQueue;
+    // 已收到、还没上屏的输入：收到的时间，以及第一帧包含它的帧序号（0表示还没开始渲染）
+    struct PendingInput {
+        qint64 receivedNs;
+        quint64 frame;
+    };
+    QVector<qint64> m_queuedInput;          // 还在m_inputQueue里的
+    QVector<PendingInput> m_pendingInput;   // 已投递，等待上屏
+    ZQuick::LatencyHistogram m_inputLatency;
+
+    ZQuick::FrameRateGovernor *m_governor;
+    QTimer *m_frameTimer;   // 还没到下一帧的时间时，等它再投递UPDATE
 };
 
 #endif // ZQUICKWIDGET_H
@@ -0,0 +1,49 @@
+# ZQuickWidget及其依赖的源文件，供各个工程include
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+        $$PWD/zquickwidget.cpp \
+        $$PWD/zframereadback.cpp \
+        $$PWD/zglpresenter.cpp \
+        $$PWD/zrenderthreadpool.cpp \
+        $$PWD/zcomponentcache.cpp \
+        $$PWD/zframetimings.cpp \
+        $$PWD/zframediff.cpp \
+        $$PWD/zframerategovernor.cpp \
+        $$PWD/zoffscreenqmlrenderer.cpp \
+        $$PWD/zpixelconvert.cpp \
+        $$PWD/zframerecorder.cpp \
+        $$PWD/zgpuconvertpass.cpp \
+        $$PWD/zinputqueue.cpp \
+        $$PWD/zlatencyhistogram.cpp \
+        $$PWD/zincubationcontroller.cpp \
+        $$PWD/zshmframesink.cpp \
+        $$PWD/zatlascompositor.cpp \
+        $$PWD/zrenderanimationdriver.cpp
+
+HEADERS += \
+    $$PWD/zquickwidget.h \
+    $$PWD/zframereadback.h \
+    $$PWD/zframemailbox.h \
+    $$PWD/zglpresenter.h \
+    $$PWD/zrenderthreadpool.h \
+    $$PWD/zcomponentcache.h \
+    $$PWD/zframetimings.h \
+    $$PWD/zframediff.h \
+    $$PWD/zframerategovernor.h \
+    $$PWD/zoffscreenqmlrenderer.h \
+    $$PWD/zsimd_p.h \
+    $$PWD/zpixelconvert.h \
+    $$PWD/zframesink.h \
+    $$PWD/zframerecorder.h \
+    $$PWD/zgpuconvertpass.h \
+    $$PWD/zinputqueue.h \
+    $$PWD/zlatencyhistogram.h \
+    $$PWD/zincubationcontroller.h \
+    $$PWD/zshmframering.h \
+    $$PWD/zshmframesink.h \
+    $$PWD/zatlascompositor.h \
+    $$PWD/zrenderanimationdriver.h
+
+# 共享内存帧环形缓冲用到shm_open
+linux: LIBS += -lrt
@@ -0,0 +1,91 @@
+﻿#include "zrenderanimationdriver.h"
+#include "zquickwidget.h"
+
+#include <QThreadStorage>
+#include <QAtomicInt>
+
+using namespace ZQuick;
+
+static QAtomicInt s_interval(16);
+
+// QThreadStorage在线程退出时会删除留下的驱动，正常情况下最后一个渲染器离开时就已经删掉了
+static QThreadStorage<RenderAnimationDriver *> s_drivers;
+
+RenderAnimationDriver::RenderAnimationDriver()
+{
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &RenderAnimationDriver::tick);
+}
+
+RenderAnimationDriver *RenderAnimationDriver::attach(QuickRenderer *renderer)
+{
+    RenderAnimationDriver *driver = s_drivers.localData();
+    if (!driver) {
+        driver = new RenderAnimationDriver;
+        driver->install();
+        s_drivers.setLocalData(driver);
+    }
+    if (!driver->m_renderers.contains(renderer))
+        driver->m_renderers.append(renderer);
+    return driver;
+}
+
+void RenderAnimationDriver::detach(QuickRenderer *renderer)
+{
+    m_renderers.removeAll(renderer);
+    m_requested.removeAll(renderer);
+    if (m_renderers.isEmpty()) {
+        // setLocalData会删除原来的值，也就是自己；
+        // 基类析构时卸载，本线程上还在运行的动画交还给Qt默认的驱动
+        s_drivers.setLocalData(nullptr);
+    }
+}
+
+void RenderAnimationDriver::requestFrame(QuickRenderer *renderer)
+{
+    if (!m_requested.contains(renderer))
+        m_requested.append(renderer);
+
+    // 动画停下之后最后一次提交的值也要画出来
+    if (!m_timer.isActive())
+        m_timer.start(interval());
+}
+
+void RenderAnimationDriver::setInterval(int msecs)
+{
+    s_interval.storeRelaxed(qMax(1, msecs));
+}
+
+int RenderAnimationDriver::interval()
+{
+    return s_interval.loadRelaxed();
+}
+
+void RenderAnimationDriver::start()
+{
+    QAnimationDriver::start();
+    if (!m_timer.isActive())
+        m_timer.start(interval());
+}
+
+void RenderAnimationDriver::stop()
+{
+    // 不马上停定时器，等最后一次请求的帧画完
+    QAnimationDriver::stop();
+}
+
+void RenderAnimationDriver::tick()
+{
+    // 先推进本线程上的Animator，新的值在render时写进场景图
+    if (isRunning())
+        advance();
+
+    // render会再次请求刷新（动画还在运行时），这里先换出来
+    const QVector<QuickRenderer *> requested = m_requested;
+    m_requested.clear();
+    for (QuickRenderer *renderer : requested)
+        renderer->renderAnimationFrame();
+
+    if (!isRunning() && m_requested.isEmpty())
+        m_timer.stop();
+}
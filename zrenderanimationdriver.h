@@ -0,0 +1,55 @@
+﻿#ifndef ZRENDERANIMATIONDRIVER_H
+#define ZRENDERANIMATIONDRIVER_H
+
+#include <QAnimationDriver>
+#include <QTimer>
+#include <QVector>
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+class QuickRenderer;
+
+// 渲染线程上的动画驱动
+// Animator（OpacityAnimator、RotationAnimator、ScaleAnimator、XAnimator等）在sync时交给渲染线程，
+// 由渲染线程上的QAnimationDriver推进，每次render时把新的值写进场景图，再调用window->update()要下一帧。
+// 离屏窗口的update()只会发出renderRequested，以前要绕回ui线程才能发起下一帧，ui线程一忙动画就停住。
+// 这里在渲染线程上用定时器推进动画，并直接让请求过刷新的渲染器只render一帧，不经过ui线程。
+//
+// 动画时间是按线程的（QUnifiedTimer），一个渲染线程一个驱动，线程上的渲染器共用；
+// 只能在渲染线程上使用，最后一个渲染器离开时删除
+class RenderAnimationDriver : public QAnimationDriver
+{
+    Q_OBJECT
+
+public:
+    // 当前线程的驱动，没有时创建并安装
+    static RenderAnimationDriver *attach(QuickRenderer *renderer);
+    void detach(QuickRenderer *renderer);
+
+    // renderer的窗口在渲染线程上请求了刷新，下一次推进动画之后给它render一帧
+    void requestFrame(QuickRenderer *renderer);
+
+    // 推进的间隔，默认16ms；对之后启动的驱动生效，可在任意线程调用
+    static void setInterval(int msecs);
+    static int interval();
+
+protected:
+    void start() override;
+    void stop() override;
+
+private:
+    RenderAnimationDriver();
+    void tick();
+
+    QTimer m_timer;
+    QVector<QuickRenderer *> m_renderers;
+    QVector<QuickRenderer *> m_requested;
+};
+
+}
+
+#endif // ZRENDERANIMATIONDRIVER_H
@@ -0,0 +1,232 @@
+﻿#include "zrenderthreadpool.h"
+
+#include <QThread>
+#include <QCoreApplication>
+#include <QPointer>
+#include <QDebug>
+
+#if defined(Q_OS_LINUX)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <cerrno>
+#include <cstring>
+#elif defined(Q_OS_WIN)
+#include <windows.h>
+#endif
+
+using namespace ZQuick;
+
+// 在目标线程里执行：Linux上的亲和性、nice和线程名都只能方便地对当前线程设置
+static void applyToCurrentThread(const ThreadScheduling &s)
+{
+    QThread *thread = QThread::currentThread();
+
+    if (s.priority != QThread::InheritPriority
+            && s.policy != ThreadScheduling::Fifo && s.policy != ThreadScheduling::RoundRobin)
+        thread->setPriority(s.priority);
+
+#if defined(Q_OS_LINUX)
+    const pid_t tid = pid_t(syscall(SYS_gettid));
+
+    // 没有设置的项不碰，保留从进程继承来的亲和性、策略和nice
+    if (!s.cpus.isEmpty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : s.cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &set);
+        }
+        if (sched_setaffinity(tid, sizeof(set), &set) != 0)
+            qWarning() << "RenderThreadPool: cannot set CPU affinity" << s.cpus << strerror(errno);
+    }
+
+    if (s.policy != ThreadScheduling::Inherit) {
+        int policy = SCHED_OTHER;
+        sched_param param;
+        memset(&param, 0, sizeof(param));
+        switch (s.policy) {
+        case ThreadScheduling::Batch:      policy = SCHED_BATCH; break;
+        case ThreadScheduling::Idle:       policy = SCHED_IDLE; break;
+        case ThreadScheduling::Fifo:       policy = SCHED_FIFO; break;
+        case ThreadScheduling::RoundRobin: policy = SCHED_RR; break;
+        default: break;
+        }
+        if (policy == SCHED_FIFO || policy == SCHED_RR) {
+            param.sched_priority = qBound(sched_get_priority_min(policy), s.realtimePriority,
+                                          sched_get_priority_max(policy));
+        }
+        // 返回的是错误码而不是-1/errno
+        if (const int err = pthread_setschedparam(pthread_self(), policy, &param))
+            qWarning() << "RenderThreadPool: cannot set scheduling policy" << s.policy << strerror(err);
+    }
+
+    if (s.nice != ThreadScheduling::InheritNice) {
+        if (setpriority(PRIO_PROCESS, id_t(tid), qBound(-20, s.nice, 19)) != 0)
+            qWarning() << "RenderThreadPool: cannot set nice" << s.nice << strerror(errno);
+    }
+
+    if (!s.name.isEmpty())
+        pthread_setname_np(pthread_self(), s.name.left(15).toLocal8Bit().constData());
+#elif defined(Q_OS_WIN)
+    if (!s.cpus.isEmpty()) {
+        DWORD_PTR mask = 0;
+        for (int cpu : s.cpus) {
+            if (cpu >= 0 && cpu < int(sizeof(DWORD_PTR) * 8))
+                mask |= DWORD_PTR(1) << cpu;
+        }
+        if (!SetThreadAffinityMask(GetCurrentThread(), mask))
+            qWarning() << "RenderThreadPool: cannot set CPU affinity" << s.cpus;
+    }
+#endif
+
+    // 线程名之外，QThread的objectName也跟着改，方便调试器里辨认
+    if (!s.name.isEmpty())
+        thread->setObjectName(s.name);
+}
+
+RenderThreadPool *RenderThreadPool::instance()
+{
+    // 跟随QCoreApplication一起销毁，退出前把剩下的线程停掉
+    static QPointer<RenderThreadPool> pool;
+    if (!pool)
+        pool = new RenderThreadPool;
+    return pool;
+}
+
+RenderThreadPool::RenderThreadPool()
+    : QObject(QCoreApplication::instance()),
+    m_maxThreadCount(qMax(1, QThread::idealThreadCount())),
+    m_createdCount(0)
+{
+}
+
+RenderThreadPool::~RenderThreadPool()
+{
+    for (const Worker &w : qAsConst(m_workers)) {
+        w.thread->quit();
+        w.thread->wait();
+        delete w.agent;
+        delete w.thread;
+    }
+}
+
+void RenderThreadPool::apply(const Worker &worker, const ThreadScheduling &scheduling)
+{
+    QMetaObject::invokeMethod(worker.agent, [scheduling] {
+        applyToCurrentThread(scheduling);
+    }, Qt::QueuedConnection);
+}
+
+void RenderThreadPool::applyDefault(const Worker &worker, const ThreadScheduling &scheduling)
+{
+    ThreadScheduling s = scheduling;
+    // Linux的线程名最多15个字符，先截短前缀再加编号，否则截掉的正好是区分线程的编号
+    if (!s.name.isEmpty()) {
+        const QString suffix = QStringLiteral("-%1").arg(worker.index);
+        s.name = s.name.left(qMax(1, 15 - suffix.size())) + suffix;
+    }
+    apply(worker, s);
+}
+
+void RenderThreadPool::setScheduling(const ThreadScheduling &scheduling)
+{
+    QMutexLocker lock(&m_mutex);
+    m_scheduling = scheduling;
+    for (const Worker &w : qAsConst(m_workers))
+        applyDefault(w, scheduling);
+}
+
+ThreadScheduling RenderThreadPool::scheduling() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_scheduling;
+}
+
+void RenderThreadPool::setScheduling(QThread *thread, const ThreadScheduling &scheduling)
+{
+    QMutexLocker lock(&m_mutex);
+    for (const Worker &w : qAsConst(m_workers)) {
+        if (w.thread == thread) {
+            apply(w, scheduling);
+            return;
+        }
+    }
+    // 合成器等用acquire()分配的线程都在这里；找不到说明线程不是池里的或已经释放了
+    qWarning() << "RenderThreadPool: setScheduling() on a thread not owned by the pool" << thread;
+}
+
+void RenderThreadPool::setMaxThreadCount(int count)
+{
+    QMutexLocker lock(&m_mutex);
+    m_maxThreadCount = qMax(1, count);
+}
+
+int RenderThreadPool::maxThreadCount() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_maxThreadCount;
+}
+
+int RenderThreadPool::threadCount() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_workers.size();
+}
+
+QThread *RenderThreadPool::acquire()
+{
+    QMutexLocker lock(&m_mutex);
+
+    if (m_workers.size() < m_maxThreadCount) {
+        Worker w;
+        w.thread = new QThread;
+        w.index = m_createdCount++;
+        w.thread->setObjectName(QStringLiteral("ZQuickRender-%1").arg(w.index));
+        w.agent = new QObject;
+        w.agent->moveToThread(w.thread);
+        w.thread->start();
+        w.users = 1;
+        // 排在渲染器的任何事件之前执行
+        applyDefault(w, m_scheduling);
+        m_workers.append(w);
+        return w.thread;
+    }
+
+    // 选使用者最少的线程
+    int best = 0;
+    for (int i = 1; i < m_workers.size(); ++i) {
+        if (m_workers[i].users < m_workers[best].users)
+            best = i;
+    }
+    m_workers[best].users++;
+    return m_workers[best].thread;
+}
+
+void RenderThreadPool::release(QThread *thread)
+{
+    QThread *finished = nullptr;
+    QObject *agent = nullptr;
+    {
+        QMutexLocker lock(&m_mutex);
+        for (int i = 0; i < m_workers.size(); ++i) {
+            if (m_workers[i].thread != thread)
+                continue;
+            if (--m_workers[i].users == 0) {
+                finished = thread;
+                agent = m_workers[i].agent;
+                m_workers.remove(i);
+            }
+            break;
+        }
+    }
+
+    if (finished) {
+        finished->quit();
+        finished->wait();
+        delete agent;
+        delete finished;
+    }
+}
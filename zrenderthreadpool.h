@@ -0,0 +1,95 @@
+﻿#ifndef ZRENDERTHREADPOOL_H
+#define ZRENDERTHREADPOOL_H
+
+#include <QObject>
+#include <QVector>
+#include <QMutex>
+#include <QThread>
+#include <climits>
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+// 渲染线程的调度设置，可以在运行中随时修改
+// 亲和性、调度策略和nice只在Linux上有效（亲和性在Windows上也有效），
+// 没有权限时（例如实时策略需要CAP_SYS_NICE）打印警告并保持原样。
+// 每一项都有“不设置”的默认值，不设置的项保持线程继承来的状态（taskset/cpuset的亲和性、nice启动时的nice值等），
+// 默认构造的设置什么都不改
+struct ThreadScheduling
+{
+    enum Policy {
+        Inherit,        // 不设置，保持继承的策略
+        Default,        // SCHED_OTHER
+        Batch,          // SCHED_BATCH：不抢占交互进程，适合吞吐优先
+        Idle,           // SCHED_IDLE：只在CPU空闲时运行
+        Fifo,           // SCHED_FIFO，使用realtimePriority
+        RoundRobin      // SCHED_RR，使用realtimePriority
+    };
+
+    enum { InheritNice = INT_MIN };
+
+    // 设置了实时策略时忽略，避免Qt按当前策略重新换算优先级
+    QThread::Priority priority = QThread::InheritPriority;
+    QVector<int> cpus;          // 允许运行的CPU编号，空表示保持继承的亲和性
+    Policy policy = Inherit;
+    int realtimePriority = 1;   // 1~99，Fifo/RoundRobin下有效
+    int nice = InheritNice;     // -20~19，对SCHED_OTHER/SCHED_BATCH有效；调低需要权限
+    QString name;               // 线程名（perf/top里显示，最多15个字符），空表示保持线程池起的名字
+};
+
+// 多个ZQuickWidget共用的渲染线程池
+// 线程数没有达到上限时，每个渲染器独占一个线程；
+// 达到上限后，新的渲染器分配到使用者最少的线程上。
+// 同一线程上的渲染器通过投递事件排队，每个渲染器同一时间最多只有
+// 一帧在队列里，sync和render又拆成两个事件，所以谁也饿不死谁
+class RenderThreadPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    static RenderThreadPool *instance();
+
+    // 默认为QThread::idealThreadCount()，只影响之后分配的渲染器
+    void setMaxThreadCount(int count);
+    int maxThreadCount() const;
+    int threadCount() const;
+
+    QThread *acquire();
+    // 线程没有使用者之后会被退出并销毁
+    void release(QThread *thread);
+
+    // 所有渲染线程的默认设置，立即应用到现有线程，之后新建的线程也使用它
+    void setScheduling(const ThreadScheduling &scheduling);
+    ThreadScheduling scheduling() const;
+    // 单独设置一个线程，只改设置了的项；线程被多个渲染器共用时，每一项以最后一次设置为准。
+    // 只对acquire()分配出去的线程有效（包括AtlasCompositor的线程），其它线程只给出警告
+    void setScheduling(QThread *thread, const ThreadScheduling &scheduling);
+
+private:
+    RenderThreadPool();
+    ~RenderThreadPool();
+
+    struct Worker {
+        QThread *thread = nullptr;
+        QObject *agent = nullptr;   // 住在线程上，用来把设置投递到线程里执行
+        int index = 0;
+        int users = 0;
+    };
+
+    static void apply(const Worker &worker, const ThreadScheduling &scheduling);
+    // 默认设置里的线程名加上编号，每个线程各不相同
+    static void applyDefault(const Worker &worker, const ThreadScheduling &scheduling);
+
+    mutable QMutex m_mutex;
+    ThreadScheduling m_scheduling;
+    QVector<Worker> m_workers;
+    int m_maxThreadCount;
+    int m_createdCount;
+};
+
+}
+
+#endif // ZRENDERTHREADPOOL_H
@@ -0,0 +1,357 @@
+﻿#ifndef ZSHMFRAMERING_H
+#define ZSHMFRAMERING_H
+
+// 跨进程共享内存的帧环形缓冲
+// 只依赖C++11和POSIX，不依赖Qt，其它进程（推流、录制）直接包含这个头文件即可：
+//     g++ -O2 -std=c++11 reader.cpp -lrt
+//
+// 布局：[Header][Slot描述 x N][像素数据 x N]，像素数据按4096字节对齐
+// 写端每帧写入 sequence % N 号槽位，槽位的version是一个seqlock：写入时为奇数，写完为偶数；
+// 读端直接在映射的内存上读像素（零拷贝），读完再检查一次version没变，变了说明这一帧在读的过程中被覆盖了。
+// N个槽位意味着读端最多有N-1帧的时间处理一帧，不会阻塞写端；写端也从不等读端。
+// 新帧通知用futex：读端在Header::notify上等待，写端每帧加一并唤醒
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ZQuick {
+namespace ShmFrameRing {
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "shared memory needs lock-free atomics");
+
+enum : uint32_t {
+    Magic = 0x5251465a,     // "ZFQR"
+    Version = 1
+};
+
+// 像素格式，都是每像素4字节
+enum PixelFormat : uint32_t {
+    Bgra8Premultiplied = 1,     // QImage::Format_ARGB32_Premultiplied在小端机器上的内存顺序
+    Rgba8Premultiplied = 2,     // QImage::Format_RGBA8888_Premultiplied
+    Bgrx8 = 3                   // QImage::Format_RGB32
+};
+
+struct alignas(64) Header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t reserved;
+    uint64_t slotBytes;         // 每个槽位像素区的容量
+    uint64_t dataOffset;        // 第一个槽位像素区相对映射起点的偏移
+
+    alignas(64) std::atomic<uint64_t> latest;   // 最新写完的帧号，0表示还没有帧
+    std::atomic<uint32_t> notify;               // futex字，每写完一帧加一
+    std::atomic<uint32_t> waiters;              // 正在等待的读端数，为0时写端不做系统调用
+    std::atomic<uint32_t> writerAlive;          // 写端关闭时清零，读端据此退出
+};
+
+struct alignas(64) Slot
+{
+    std::atomic<uint64_t> version;
+    std::atomic<uint64_t> sequence;     // 全局帧号（与槽位号对应），从1开始
+    std::atomic<uint64_t> frameNumber;  // 写端自己的帧序号，例如ZQuickWidget的帧号
+    std::atomic<int64_t> timestampNs;   // 写端的单调时钟
+    std::atomic<uint32_t> width;
+    std::atomic<uint32_t> height;
+    std::atomic<uint32_t> stride;
+    std::atomic<uint32_t> format;
+};
+
+inline uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+inline uint64_t totalBytes(uint32_t slotCount, uint64_t slotBytes)
+{
+    const uint64_t data = alignUp(sizeof(Header) + sizeof(Slot) * slotCount, 4096);
+    return data + alignUp(slotBytes, 4096) * slotCount;
+}
+
+// 读端拿到的一帧，pixels直接指向共享内存
+struct Frame
+{
+    const uint8_t *pixels = nullptr;
+    uint64_t sequence = 0;
+    uint64_t frameNumber = 0;
+    int64_t timestampNs = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t stride = 0;
+    uint32_t format = 0;
+
+    uint32_t slot = 0;
+    uint64_t version = 0;
+};
+
+#if defined(__linux__)
+
+inline void futexWake(std::atomic<uint32_t> *word)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+inline void futexWait(std::atomic<uint32_t> *word, uint32_t expected, int timeoutMs)
+{
+    timespec ts;
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = long(timeoutMs % 1000) * 1000000;
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT, expected,
+            timeoutMs >= 0 ? &ts : nullptr, nullptr, 0);
+}
+
+// 共享内存的名字按shm_open的要求以'/'开头
+inline std::string shmName(const std::string &name)
+{
+    return name.empty() || name[0] == '/' ? name : "/" + name;
+}
+
+class Writer
+{
+public:
+    Writer() {}
+    ~Writer() { close(); }
+
+    // 创建（或重新创建）共享内存；slotBytes为一帧像素的最大字节数
+    bool open(const std::string &name, uint32_t slotCount, uint64_t slotBytes)
+    {
+        close();
+        if (slotCount < 2 || slotBytes == 0)
+            return false;
+
+        m_name = shmName(name);
+        shm_unlink(m_name.c_str());
+        const int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+            return false;
+
+        m_size = totalBytes(slotCount, slotBytes);
+        if (ftruncate(fd, off_t(m_size)) != 0) {
+            ::close(fd);
+            shm_unlink(m_name.c_str());
+            return false;
+        }
+
+        void *map = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            shm_unlink(m_name.c_str());
+            return false;
+        }
+
+        // ftruncate出来的内存全为0，atomic的初始状态就是0
+        m_base = static_cast<uint8_t *>(map);
+        m_header = reinterpret_cast<Header *>(m_base);
+        m_slots = reinterpret_cast<Slot *>(m_base + sizeof(Header));
+        m_header->slotCount = slotCount;
+        m_header->slotBytes = slotBytes;
+        m_header->dataOffset = alignUp(sizeof(Header) + sizeof(Slot) * slotCount, 4096);
+        m_header->version = Version;
+        m_header->writerAlive.store(1, std::memory_order_relaxed);
+        // magic最后写，读端看到magic就说明其余字段已经就绪
+        std::atomic_thread_fence(std::memory_order_release);
+        m_header->magic = Magic;
+        m_next = 1;
+        return true;
+    }
+
+    void close()
+    {
+        if (!m_base)
+            return;
+        m_header->writerAlive.store(0, std::memory_order_release);
+        m_header->notify.fetch_add(1, std::memory_order_release);
+        futexWake(&m_header->notify);
+        munmap(m_base, m_size);
+        shm_unlink(m_name.c_str());
+        m_base = nullptr;
+        m_header = nullptr;
+        m_slots = nullptr;
+    }
+
+    bool isOpen() const { return m_base != nullptr; }
+    uint64_t slotBytes() const { return m_header ? m_header->slotBytes : 0; }
+
+    // 写入一帧，超出槽位容量时返回false
+    bool write(const void *pixels, uint32_t width, uint32_t height, uint32_t stride, PixelFormat format,
+               uint64_t frameNumber, int64_t timestampNs)
+    {
+        const uint64_t bytes = uint64_t(stride) * height;
+        if (!m_base || bytes > m_header->slotBytes || stride < width * 4)
+            return false;
+
+        const uint64_t sequence = m_next++;
+        const uint32_t index = uint32_t(sequence % m_header->slotCount);
+        Slot &slot = m_slots[index];
+        uint8_t *dst = m_base + m_header->dataOffset + alignUp(m_header->slotBytes, 4096) * index;
+
+        // 奇数版本：正在写
+        const uint64_t v = slot.version.load(std::memory_order_relaxed);
+        slot.version.store(v + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        memcpy(dst, pixels, size_t(bytes));
+        slot.sequence.store(sequence, std::memory_order_relaxed);
+        slot.frameNumber.store(frameNumber, std::memory_order_relaxed);
+        slot.timestampNs.store(timestampNs, std::memory_order_relaxed);
+        slot.width.store(width, std::memory_order_relaxed);
+        slot.height.store(height, std::memory_order_relaxed);
+        slot.stride.store(stride, std::memory_order_relaxed);
+        slot.format.store(format, std::memory_order_relaxed);
+
+        slot.version.store(v + 2, std::memory_order_release);
+        m_header->latest.store(sequence, std::memory_order_release);
+        m_header->notify.fetch_add(1, std::memory_order_release);
+        if (m_header->waiters.load(std::memory_order_acquire))
+            futexWake(&m_header->notify);
+        return true;
+    }
+
+private:
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+
+    std::string m_name;
+    uint8_t *m_base = nullptr;
+    Header *m_header = nullptr;
+    Slot *m_slots = nullptr;
+    uint64_t m_size = 0;
+    uint64_t m_next = 1;
+};
+
+class Reader
+{
+public:
+    Reader() {}
+    ~Reader() { close(); }
+
+    bool open(const std::string &name)
+    {
+        close();
+        const int fd = shm_open(shmName(name).c_str(), O_RDWR, 0);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || uint64_t(st.st_size) < sizeof(Header)) {
+            ::close(fd);
+            return false;
+        }
+
+        // 需要写权限：等待时要修改waiters
+        void *map = mmap(nullptr, size_t(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED)
+            return false;
+
+        m_base = static_cast<uint8_t *>(map);
+        m_size = uint64_t(st.st_size);
+        m_header = reinterpret_cast<Header *>(m_base);
+        if (m_header->magic != Magic || m_header->version != Version
+                || totalBytes(m_header->slotCount, m_header->slotBytes) > m_size) {
+            close();
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        m_slots = reinterpret_cast<Slot *>(m_base + sizeof(Header));
+        return true;
+    }
+
+    void close()
+    {
+        if (m_base)
+            munmap(m_base, m_size);
+        m_base = nullptr;
+        m_header = nullptr;
+        m_slots = nullptr;
+    }
+
+    bool isOpen() const { return m_base != nullptr; }
+    bool writerAlive() const { return m_header && m_header->writerAlive.load(std::memory_order_acquire); }
+    uint64_t latest() const { return m_header ? m_header->latest.load(std::memory_order_acquire) : 0; }
+
+    // 等到有比after新的帧、写端关闭或超时；返回最新帧号
+    uint64_t wait(uint64_t after, int timeoutMs)
+    {
+        if (!m_header)
+            return 0;
+        const uint32_t word = m_header->notify.load(std::memory_order_acquire);
+        uint64_t current = latest();
+        if (current > after || !writerAlive())
+            return current;
+
+        m_header->waiters.fetch_add(1, std::memory_order_acq_rel);
+        // 登记之后再检查一次，避免错过写端在这之间发出的唤醒
+        if (latest() <= after)
+            futexWait(&m_header->notify, word, timeoutMs);
+        m_header->waiters.fetch_sub(1, std::memory_order_acq_rel);
+        return latest();
+    }
+
+    // 取sequence这一帧，已经被覆盖或正在写时返回false；
+    // 用完pixels之后调用isValid()确认读的过程中没有被覆盖
+    bool acquire(uint64_t sequence, Frame *frame) const
+    {
+        if (!m_header || sequence == 0)
+            return false;
+
+        const uint32_t index = uint32_t(sequence % m_header->slotCount);
+        const Slot &slot = m_slots[index];
+        const uint64_t v = slot.version.load(std::memory_order_acquire);
+        if (v & 1)
+            return false;
+
+        frame->sequence = slot.sequence.load(std::memory_order_relaxed);
+        frame->frameNumber = slot.frameNumber.load(std::memory_order_relaxed);
+        frame->timestampNs = slot.timestampNs.load(std::memory_order_relaxed);
+        frame->width = slot.width.load(std::memory_order_relaxed);
+        frame->height = slot.height.load(std::memory_order_relaxed);
+        frame->stride = slot.stride.load(std::memory_order_relaxed);
+        frame->format = slot.format.load(std::memory_order_relaxed);
+        frame->pixels = m_base + m_header->dataOffset + alignUp(m_header->slotBytes, 4096) * index;
+        frame->slot = index;
+        frame->version = v;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return frame->sequence == sequence && slot.version.load(std::memory_order_relaxed) == v;
+    }
+
+    bool isValid(const Frame &frame) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return m_slots && m_slots[frame.slot].version.load(std::memory_order_relaxed) == frame.version;
+    }
+
+private:
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+
+    uint8_t *m_base = nullptr;
+    Header *m_header = nullptr;
+    Slot *m_slots = nullptr;
+    uint64_t m_size = 0;
+};
+
+#endif // __linux__
+
+}
+}
+
+#endif // ZSHMFRAMERING_H
@@ -0,0 +1,100 @@
+﻿#include "zshmframesink.h"
+#include "zshmframering.h"
+
+#include <QDebug>
+
+using namespace ZQuick;
+
+#if defined(__linux__)
+
+SharedMemoryFrameSink::SharedMemoryFrameSink()
+{
+}
+
+SharedMemoryFrameSink::~SharedMemoryFrameSink()
+{
+}
+
+bool SharedMemoryFrameSink::open(const QString &name, const QSize &maxSize, int slotCount)
+{
+    if (maxSize.isEmpty() || slotCount < 2) {
+        qWarning() << "SharedMemoryFrameSink: invalid size or slot count" << maxSize << slotCount;
+        return false;
+    }
+
+    QScopedPointer<ShmFrameRing::Writer> writer(new ShmFrameRing::Writer);
+    const quint64 slotBytes = quint64(maxSize.width()) * quint64(maxSize.height()) * 4;
+    if (!writer->open(name.toStdString(), uint32_t(slotCount), slotBytes)) {
+        qWarning() << "SharedMemoryFrameSink: cannot create shared memory" << name << strerror(errno);
+        return false;
+    }
+
+    m_writer.swap(writer);
+    return true;
+}
+
+void SharedMemoryFrameSink::close()
+{
+    QMutexLocker lock(&m_writeMutex);
+    m_writer.reset();
+}
+
+bool SharedMemoryFrameSink::isOpen() const
+{
+    return m_writer && m_writer->isOpen();
+}
+
+void SharedMemoryFrameSink::frameReady(const QImage &image, quint64 sequence, qint64 timestampNs)
+{
+    // Writer的槽位和头部的发布序号都不是线程安全的，两个渲染线程同时写会写进同一个槽
+    QMutexLocker lock(&m_writeMutex);
+    if (!m_writer)
+        return;
+
+    ShmFrameRing::PixelFormat format;
+    switch (image.format()) {
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_ARGB32:
+        format = ShmFrameRing::Bgra8Premultiplied;
+        break;
+    case QImage::Format_RGBA8888_Premultiplied:
+    case QImage::Format_RGBA8888:
+        format = ShmFrameRing::Rgba8Premultiplied;
+        break;
+    case QImage::Format_RGB32:
+        format = ShmFrameRing::Bgrx8;
+        break;
+    default:
+        m_skipped.fetchAndAddRelaxed(1);
+        return;
+    }
+
+    if (m_writer->write(image.constBits(), uint32_t(image.width()), uint32_t(image.height()),
+                        uint32_t(image.bytesPerLine()), format, sequence, timestampNs))
+        m_written.fetchAndAddRelaxed(1);
+    else
+        m_skipped.fetchAndAddRelaxed(1);
+}
+
+#else
+
+// 其它平台没有futex，不提供
+namespace ZQuick { namespace ShmFrameRing { class Writer {}; } }
+
+SharedMemoryFrameSink::SharedMemoryFrameSink() {}
+SharedMemoryFrameSink::~SharedMemoryFrameSink() {}
+
+bool SharedMemoryFrameSink::open(const QString &, const QSize &, int)
+{
+    qWarning("SharedMemoryFrameSink: only supported on Linux");
+    return false;
+}
+
+void SharedMemoryFrameSink::close() {}
+bool SharedMemoryFrameSink::isOpen() const { return false; }
+
+void SharedMemoryFrameSink::frameReady(const QImage &, quint64, qint64)
+{
+}
+
+#endif
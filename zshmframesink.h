@@ -0,0 +1,54 @@
+﻿#ifndef ZSHMFRAMESINK_H
+#define ZSHMFRAMESINK_H
+
+#include <QString>
+#include <QMutex>
+#include <QAtomicInteger>
+#include <QScopedPointer>
+
+#include "zframesink.h"
+
+#ifdef Q_OS_WIN
+#pragma execution_character_set("utf-8")
+#endif
+
+namespace ZQuick {
+
+namespace ShmFrameRing { class Writer; }
+
+// 把每一帧发布到命名的共享内存环形缓冲里，给同一台机器上的其它进程（推流、录制）使用
+// 布局和读端见zshmframering.h，读端不依赖Qt；示例见ShmReader/。
+// 只在Linux上可用，其它平台open()返回false。
+// 帧在渲染线程上直接拷进共享内存（每帧一次memcpy），读端在映射上原地读取，不再转换、序列化。
+// 环形缓冲只允许一个写者：同一个sink挂在多个控件上时，各自渲染线程的写入用互斥锁串行，
+// 等待的最多是另一帧的一次memcpy
+class SharedMemoryFrameSink : public FrameSink
+{
+public:
+    SharedMemoryFrameSink();
+    ~SharedMemoryFrameSink() override;
+
+    // name为shm_open的名字（例如"zquick-ui"，对应/dev/shm/zquick-ui）；
+    // maxSize为可能出现的最大画面尺寸（像素），超出的帧会被跳过。
+    // open()要在addFrameSink()之前，close()要在removeFrameSink()之后调用
+    bool open(const QString &name, const QSize &maxSize, int slotCount = 4);
+    void close();
+    bool isOpen() const;
+
+    quint64 writtenFrames() const { return m_written.loadRelaxed(); }
+    quint64 skippedFrames() const { return m_skipped.loadRelaxed(); }
+
+    void frameReady(const QImage &image, quint64 sequence, qint64 timestampNs) override;
+
+private:
+    Q_DISABLE_COPY(SharedMemoryFrameSink)
+
+    QMutex m_writeMutex;    // 保护m_writer的写入，frameReady可能同时在多个渲染线程上调用
+    QScopedPointer<ShmFrameRing::Writer> m_writer;
+    QAtomicInteger<quint64> m_written;
+    QAtomicInteger<quint64> m_skipped;
+};
+
+}
+
+#endif // ZSHMFRAMESINK_H
@@ -0,0 +1,64 @@
+﻿#ifndef ZSIMD_P_H
+#define ZSIMD_P_H
+
+// 仅供本库的.cpp内部使用：SIMD指令集的编译期检测和运行时检测
+//
+// ZQUICK_HAVE_SSE2  编译器默认就能生成SSE2（x86-64总是可以）
+// ZQUICK_HAVE_AVX2  可以编译AVX2函数，需要加ZQUICK_TARGET_AVX2，
+//                   并且只能在cpuHasAvx2()返回true时调用
+// ZQUICK_HAVE_NEON  ARM上编译器默认就能生成NEON（AArch64总是可以）
+
+#include <QtGlobal>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ZQUICK_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+// AVX2只在支持的CPU上运行，编译时不需要打开-mavx2
+#if defined(ZQUICK_HAVE_SSE2) && (defined(__GNUC__) || defined(_MSC_VER))
+#define ZQUICK_HAVE_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define ZQUICK_TARGET_AVX2
+#else
+#define ZQUICK_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#if (defined(__ARM_NEON) || defined(__ARM_NEON__)) && Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+#define ZQUICK_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+namespace ZQuick {
+
+#ifdef ZQUICK_HAVE_AVX2
+inline bool cpuHasAvx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    // OSXSAVE + AVX，并且系统保存了YMM寄存器
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+        return false;
+    if ((_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#else
+inline bool cpuHasAvx2() { return false; }
+#endif
+
+}
+
+#endif // ZSIMD_P_H